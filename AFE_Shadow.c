@@ -0,0 +1,200 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: AFE_Shadow.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * This file keeps a shadow copy of the writable BQ769x0 registers so that register writes can be
+ * staged during a control cycle and flushed to the AFE together at the end of it
+----------------------------------------------------------------------------------------------------*/
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+#include "I2C_Handler.h"
+#include "AFE_Shadow.h"
+
+//----------------------------------------------------------------------------------------------------
+// How the shadow works:
+// - Registers 0x00-0x0B, the writable ones, are shadowed. Set and Get on anything else do nothing,
+//   so the flush can never write a read-only or reserved register.
+// - AFEVal holds what the AFE is known to contain, from the init read, the per-cycle snapshot
+//   (Shadow_Sync) and our own successful writes.
+// - Shadow_Set stages a value in NextVal and marks the register dirty.
+// - Shadow_Flush drops dirty registers whose staged value already matches the AFE, then writes
+//   each run of adjacent dirty registers with one auto-incremented multi-byte write.
+// SYS_STAT is write-1-to-clear so it is handled separately: Shadow_ClearStat accumulates the bits
+// to clear and the flush writes them once. Writing 0 to SYS_STAT has no effect, so any run that
+// starts at SYS_STAT can safely carry it.
+//----------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+static uint8_t AFEVal[SHADOW_LEN];
+static uint8_t NextVal[SHADOW_LEN];
+static uint16_t DirtyMask = 0;
+
+static uint8_t ShadowTXBuf[SHADOW_LEN];
+static I2CTrans_t ShadowTrans;
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static int8_t Shadow_Index(uint8_t reg);
+static bool Shadow_FlushRuns(void);
+
+//----------------------------------------------------------------------------------------------------
+// Read the shadowed registers from the AFE so the shadow starts out matching it
+bool Shadow_Init(void)
+{
+    uint8_t CT;
+    bool Result;
+
+    DirtyMask = 0;
+
+    Result = I2C_Read(I2C_BQ769xxADDR, SHADOW_REG, SHADOW_LEN);
+    for(CT=0; CT<SHADOW_LEN; CT++)
+    {   AFEVal[CT] = I2CRXBuf[CT];
+        NextVal[CT] = I2CRXBuf[CT];     }
+
+    //Nothing pending to clear in SYS_STAT
+    NextVal[0] = 0x00;
+
+    return Result;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Stage a register value for the next flush
+void Shadow_Set(uint8_t reg, uint8_t value)
+{
+    int8_t Index = Shadow_Index(reg);
+
+    if(Index<=0)            //Unknown register, or SYS_STAT which goes through Shadow_ClearStat
+    {   return;     }
+
+    NextVal[Index] = value;
+    DirtyMask |= (1 << Index);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Value the register will have after the next flush
+uint8_t Shadow_Get(uint8_t reg)
+{
+    int8_t Index = Shadow_Index(reg);
+
+    if(Index<0)
+    {   return 0;   }
+    return NextVal[Index];
+}
+
+//----------------------------------------------------------------------------------------------------
+// Stage SYS_STAT bits to be cleared (written as 1) on the next flush
+void Shadow_ClearStat(uint8_t bits)
+{
+    NextVal[0] |= bits;
+    DirtyMask |= 0x01;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Refresh the known AFE contents from a register image starting at SYS_STAT (the measurement
+// snapshot). Registers with a staged write keep their staged value, everything else follows the
+// AFE, e.g. when it drops DSG_ON by itself on a short circuit.
+void Shadow_Sync(const uint8_t *image)
+{
+    uint8_t CT;
+
+    for(CT=1; CT<SHADOW_LEN; CT++)
+    {
+        AFEVal[CT] = image[CT];
+        if(!(DirtyMask & (1 << CT)))
+        {   NextVal[CT] = image[CT];    }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Write every staged change to the AFE. Registers that fail to write stay dirty and are tried again
+// on the next flush.
+bool Shadow_Flush(void)
+{
+    uint8_t CT;
+    bool Result = true;
+
+    //Drop no-op writes first, SYS_STAT is only dirty while there are bits to clear
+    for(CT=1; CT<SHADOW_LEN; CT++)
+    {
+        if(NextVal[CT]==AFEVal[CT])
+        {   DirtyMask &= ~(1 << CT);    }
+    }
+    if(NextVal[0]==0x00)
+    {   DirtyMask &= ~0x01;     }
+
+    if(DirtyMask==0)
+    {   return true;    }
+
+    return Shadow_FlushRuns();
+}
+
+//----------------------------------------------------------------------------------------------------
+// Write each run of adjacent dirty registers as a single transfer
+static bool Shadow_FlushRuns(void)
+{
+    uint8_t CT = 0;
+    uint8_t RunStart;
+    uint8_t RunLen;
+    uint8_t Idx;
+    bool Result = true;
+
+    while(CT<SHADOW_LEN)
+    {
+        if(!(DirtyMask & (1 << CT)))
+        {   CT++;
+            continue;   }
+
+        RunStart = CT;
+        while(CT<SHADOW_LEN && (DirtyMask & (1 << CT)))
+        {   CT++;   }
+        RunLen = CT-RunStart;
+
+        for(Idx=0; Idx<RunLen; Idx++)
+        {   ShadowTXBuf[Idx] = NextVal[RunStart+Idx];   }
+
+        ShadowTrans.Addr = I2C_BQ769xxADDR;
+        ShadowTrans.CtrlReg = SHADOW_REG+RunStart;
+        ShadowTrans.NumCtrl = 1;
+        ShadowTrans.TXBuf = ShadowTXBuf;
+        ShadowTrans.TXBytes = RunLen;
+        ShadowTrans.RXBuf = 0;
+        ShadowTrans.RXBytes = 0;
+        ShadowTrans.Prescale = 0;
+        ShadowTrans.Prio = I2C_PRIO_PROT;                   //FET and SYS_STAT clear writes
+        ShadowTrans.ChunkLen = 0;
+        ShadowTrans.RegShift = 0;
+        ShadowTrans.Callback = 0;
+
+        if(I2C_Transfer(&ShadowTrans)==I2C_OK)
+        {
+            for(Idx=RunStart; Idx<RunStart+RunLen; Idx++)
+            {   AFEVal[Idx] = NextVal[Idx];
+                DirtyMask &= ~(1 << Idx);   }
+
+            //The bits written to SYS_STAT are cleared, not stored
+            if(RunStart==0)
+            {   AFEVal[0] = 0x00;
+                NextVal[0] = 0x00;  }
+        }
+        else
+        {   Result = false;     }
+    }
+
+    return Result;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Map a register address to its shadow index, -1 if the register is not shadowed (not writable)
+static int8_t Shadow_Index(uint8_t reg)
+{
+    if(reg>=SHADOW_REG && reg<SHADOW_REG+SHADOW_LEN)
+    {   return reg-SHADOW_REG;  }
+    return -1;
+}
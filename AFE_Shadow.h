@@ -0,0 +1,36 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: AFE_Shadow.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * This file keeps a shadow copy of the writable BQ769x0 registers so that register writes can be
+ * staged during a control cycle and flushed to the AFE together at the end of it
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef AFE_SHADOW_H
+#define AFE_SHADOW_H
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <Constants.h>
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+// Only the writable status/control registers 0x00-0x0B are shadowed. The ADC trim (0x50-0x59) is
+// read only and is read once by Init_ADCTrim instead.
+#define SHADOW_REG              REG_SYS_STAT
+#define SHADOW_LEN              12
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+bool Shadow_Init(void);
+void Shadow_Set(uint8_t reg, uint8_t value);
+uint8_t Shadow_Get(uint8_t reg);
+void Shadow_ClearStat(uint8_t bits);
+void Shadow_Sync(const uint8_t *image);
+bool Shadow_Flush(void);
+
+#endif
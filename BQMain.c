@@ -18,12 +18,20 @@
 #include "IQmathLib.h"
 #include "Constants.h"
 #include "I2C_Handler.h"
+#include "AFE_Shadow.h"
 #include "Fault_Handler.h"
 #include "BatteryData.h"
 #include "System.h"
 #include "UART_Interface.h"
 #include "Persistent.h"
 #include "ParameterData.h"
+#include "SOC_Handler.h"
+#include "SOH_Handler.h"
+#include "History_Handler.h"
+#include "CC_Offset.h"
+#include "Balance_Handler.h"
+#include "Fault_Log.h"
+#include "Latency_Handler.h"
 
 //----------------------------------------------------------------------------------------------------
 // CONSTANTS
@@ -43,15 +51,15 @@ paramResult_t CFGResult = FAILED_NULL;
 //----------------------------------------------------------------------------------------------------
 //Flow control flag variables
 
-bool Flag_LEDBTN = false;
-bool Flag_AFEALRT = false;
+volatile bool Flag_LEDBTN = false;
+volatile bool Flag_AFEALRT = false;
 bool Flag_USRRST = false;
 bool Flag_FAULT = false;
 
-uint8_t PrevFETBits=0x03; // DSG_ON=BIT1, CHG_ON=BIT0
 uint8_t FETBits=0x03; // DSG_ON=BIT1, CHG_ON=BIT0
 
 uint8_t ClearBits=0x00;
+uint32_t NewTrips=0;   // Fault_Table rows that tripped in the last pass, for the latency stats
 
 //----------------------------------------------------------------------------------------------------
 //Variables and Definitions
@@ -69,11 +77,12 @@ unsigned int BTNPWR_Return = 0;
 unsigned int SYS_Checkin_CT = 0;
 #define SYS_Checkin_LIM 16
 
+unsigned int NFC_Refresh_CT = 0;
+
 //Cell Voltages
 unsigned int Cell_VMax = 0;
 unsigned int Cell_VMin = 0;
 signed int IMeasured = 0;
-signed int IOffset = -170;
 
 //----------------------------------------------------------------------------------------------------
 // STRUCT INITS:
@@ -96,7 +105,8 @@ extern BiColorLED_t LEDB = {&P4OUT, 1, 0, LEDMode_STATIC, BiColor_OFF, BiColor_O
 void Init_App(void);
 void Init_Timers(void);
 void Alert_Handler(void);
-void Fault_Handler(void);
+void Measure_Handler(void);
+void Fault_Handler(FaultPass_t pass);
 
 //----------------------------------------------------------------------------------------------------
 //---//---//---//---//---//---//---//---//---//---//---//---//---//---//---//---//---//---//---//---//
@@ -106,21 +116,37 @@ void Fault_Handler(void);
 int main(void)
 {
     // MCU Startup Initialization:
+    WDTCTL = WDTPW | WDTHOLD;               // Hold the watchdog before the clocks speed up
 
+    Init_Clock();
     Init_GPIO();
     Init_Sys();
+    Init_Timebase();
     Init_I2C();
 
     // AFE and System State Initialization:
 
 
     Init_App();
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
+
+#ifdef PACKSTATS_BENCH
+    PackStats_Bench();                      // Results in PackStats_BenchCycles[]
+#endif
+#ifdef I2C_BENCH
+    I2C_Bench();                            // Results in I2C_BenchTicks[] and I2C_BenchISRs[]
+#endif
 
     Init_Timers();
     TB0CTL |= MC_1;
 
+#if defined(I2C_TRACE_ENABLE) || defined(DIAG_UART)
+    Init_UART();                            // Bus trace, fault log and latency dumps go out the UART
+#else
     //Init_UART();
+#endif
+
+    Latency_Start();                        // An ALERT from init is not timed
 
 
 
@@ -128,7 +154,11 @@ int main(void)
 
     while (1)
     {
-          __bis_SR_register(LPM0_bits|GIE);   // Enter LPM0 w/ interrupt
+        //Only sleep if nothing was flagged while the last pass was busy (e.g. waiting on I2C)
+        __disable_interrupt();
+        if(!Flag_AFEALRT && !Flag_LEDBTN)
+        {   __bis_SR_register(LPM0_bits|GIE);   }   // Enter LPM0 w/ interrupt
+        __enable_interrupt();
         __delay_cycles(10);
         //__bic_SR_register(GIE); // Disable global interrupts
 
@@ -137,21 +167,42 @@ int main(void)
         // If a protection is triggered
         if(Flag_AFEALRT)
         {
+            //Cleared up front, an ALERT that comes in while this cycle runs gets a cycle of its own:
+            Flag_AFEALRT=false;
+
+            //Fast path: SYS_STAT and CC only, the current and AFE latched protections, then the FETs
+            //go out (with the SYS_STAT clear) before anything else is read. A bulk transfer that is
+            //on the bus finishes its chunk, the rest of it waits until the FETs are out:
+            I2C_HoldBulk(true);
             Alert_Handler();
+            Fault_Handler(FAULT_PASS_FAST);
+            Shadow_Flush();
+            Latency_Mark(LAT_FET);
+            I2C_HoldBulk(false);
+            Latency_Commit(NewTrips);
 
-            Update_VCells(GroupA);
-            Update_VCells(GroupB);
-            Update_TSReg();
+            //Bulk path: cells, VBATT and TS, then everything that depends on them:
+            Measure_Handler();
 
-            Cell_VMax = Get_VCell_Max();
-            Cell_VMin = Get_VCell_Min();
+            //Cell statistics were refreshed with the measurements:
+            Cell_VMax = PackStats.Max_mV;
+            Cell_VMin = PackStats.Min_mV;
 
-            Fault_Handler();
+            Fault_Handler(FAULT_PASS_BULK);
+
+            //Bleed the high cells while discharge is allowed (not under UV, over temperature etc.):
+            Balance_Update((FETBits & BIT1)!=0);
+
+            //FETs of the voltage and temperature protections and the balancing go out here:
+            Shadow_Flush();
+            Latency_Trips(NewTrips);
+
+            //Fault events of this cycle go to FRAM only after the FETs are out:
+            FaultLog_Update(Cell_VMin, Cell_VMax, IMeasured);
 
             SYS_Checkin_CT=0;
 
             DBUGOUT_POUT &= ~DBUGOUT_2;
-            Flag_AFEALRT=false;
         }
 
         //------------------------------------------------------------------------------------------
@@ -180,11 +231,25 @@ int main(void)
             {   __delay_cycles(1);     }
             if(ButtonRet_PWR==LONG_PRESSED)
             {   Flag_USRRST=true;       }
+#ifdef I2C_TRACE_ENABLE
+            if(ButtonRet_FLT==SHORT_PRESSED)
+            {   I2C_Trace_Dump();       }
+#endif
+#ifdef DIAG_UART
+            if(ButtonRet_FLT==LONG_PRESSED)
+            {   FaultLog_Dump();
+                Latency_Report();       }
+#endif
             // This acts as a backup if for some reason the system misses the ALERT interrupt,
             // also convenient when it is masked during debugging:
             if((I2C_ALRT1_PIN|=I2C_ALRT1) && (SYS_Checkin_CT>SYS_Checkin_LIM))
             {   Flag_AFEALRT = true; }
 
+            //NFC configuration, read in the background between protection transfers:
+            if(NFC_Refresh_CT>=NFC_REFRESH_TICKS)
+            {   NFC_Refresh_CT=0;
+                NFC_Refresh();      }
+
             DBUGOUT_POUT &= ~DBUGOUT_1;
             Flag_LEDBTN = false;
         }
@@ -200,39 +265,44 @@ void Init_App(void)
 
     //Blink Green LED60 on system initialization:
     Set_LED_Static(&LEDA, BiColor_RED);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDA, BiColor_OFF);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDA, BiColor_YELLOW);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDA, BiColor_OFF);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDA, BiColor_GREEN);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDA, BiColor_OFF);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
 
     //Setup for BQ769x0:
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     CFGResult = ReadCFG(TARGET_FRAM_DFLT0);
     Init_BMSConfig();
+    Init_SOC();
+    Init_CCOffset();
+    Init_Faults();
     Set_ChargePump_On();
-    __delay_cycles(100000);
-    Set_CHG_DSG_Bits(BIT1+BIT0);
+    __delay_cycles(DELAY_100MS);
+    //FETs stay open for the startup CC offset calibration, Fault_Handler closes them after:
+    Set_CHG_DSG_Bits(CCOffset_Active() ? 0 : BIT1+BIT0);
+    Shadow_Flush();
 
     //Blink Green LED60 again on AFE config:
     Set_LED_Static(&LEDB, BiColor_RED);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDB, BiColor_OFF);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDB, BiColor_YELLOW);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDB, BiColor_OFF);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDB, BiColor_GREEN);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
     Set_LED_Static(&LEDB, BiColor_OFF);
-    __delay_cycles(100000);
+    __delay_cycles(DELAY_100MS);
 }
 
 //----------------------------------------------------------------------------------------------------
@@ -246,16 +316,22 @@ void Init_Timers(void)
 }
 
 //----------------------------------------------------------------------------------------------------
-//Handle incoming alerts on the I2C Interrupt line
+//Handle incoming alerts on the I2C Interrupt line, fast path: nothing here needs the cells or TS
 void Alert_Handler()
 {
-    Update_SysStat();
+    Latency_Mark(LAT_ALERT);
+
+    //SYS_STAT and CC only, the cells and TS follow once the FETs are out:
+    Update_FastStat();
+    Latency_Mark(LAT_STAT);
 
     if(GetBit_CCReady())
-    {   //First get the Coulomb counter here, then clear
-        IMeasured = Update_CCReg();
+    {   //First get the Coulomb counter here, then clear. The offset bin goes by the TS of the
+        //last cycle.
+        IMeasured = Get_CCVal_ADC();
         //Clear_CCReady();
-        IMeasured-=IOffset;
+        CCOffset_Update(IMeasured, FETBits);
+        IMeasured-=CCOffset_Get();
     }
 
     Clear_SysStat();
@@ -291,77 +367,56 @@ void Alert_Handler()
 }
 
 //----------------------------------------------------------------------------------------------------
-// Deal with all of the faults one by one, then adjust FETs accordingly
-void Fault_Handler(void)
+// Bulk path: cells, VBATT and TS, and the per cycle updates that use them along with the current
+void Measure_Handler(void)
 {
-    //Respective fault handlers, priority from lowest to highest for LED indication. Faults that
-    //are lower priority will be masked from user LED indication by higher priority faults, but
-    //will still properly protect when tripped. There are 15 total Protections:
-
-    //----------------------------------------------------------------------
-    //MCU-AUR Current in charge protections
-    FaultHandler_MCU_AUR(&MCPC_Pair, &LEDB, Flag_USRRST, IMeasured);        //Priority 15
-    FaultHandler_MCU_AUR(&BCPC_Pair, &LEDB, Flag_USRRST, IMeasured);        //Priority 14
-    //MCU-AUR Current in discharge protections
-    FaultHandler_MCU_AUR(&MCPD_Pair, &LEDB, Flag_USRRST, IMeasured);        //Priority 13
-    FaultHandler_MCU_AUR(&BCPD_Pair, &LEDB, Flag_USRRST, IMeasured);        //Priority 12
-
-    //----------------------------------------------------------------------
-    //MCU Based Battery Over/Under Temperature Protections
-    //FaultHandler_MCU_MCU(&OTPC_Pair, &LEDB, TCFET                         //Priority 11
-    //FaultHandler_MCU_MCU(&OTPD_Pair, &LEDB, TDFET                         //Priority 10
-    //FaultHandler_MCU_MCU(&OTPS_Pair, &LEDB, TRSense                       //Priority 9
-    //FaultHandler_MCU_MCU(&UTPP_Pair, &LEDB, TPCB)                         //Priority 8
-    //FaultHandler_MCU_MCU(&OTPP_Pair, &LEDB, TPCB)                         //Priority 7
-    //FaultHandler_MCU_MCU(&UTPB_Pair, &LEDB, TBattery)                     //Priority 6
-    //FaultHandler_MCU_MCU(&OTPB_Pair, &LEDB, TBattery)                     //Priority 5
-
-    //----------------------------------------------------------------------
-    //AFE-AUR Current in discharge protections
-    FaultHandler_AFE_AUR(&OCPD_Pair, &LEDB, Flag_USRRST, IMeasured);        //Priority 4
-    FaultHandler_AFE_AUR(&SCPD_Pair, &LEDB, Flag_USRRST, IMeasured);        //Priority 3
-
-    //----------------------------------------------------------------------
-    //AFE-MCU Voltage Protections
-    //FaultHandler_MCU_MCU(&CUBN, &LEDB, VDelta_Neg)
-    //FaultHandler_MCU_MCU(&CUBP, &LEDB, VDelta_Pos)
-    FaultHandler_AFE_MCU(&UVP_Pair, &LEDB, &ClearBits, Cell_VMin);          //Priority 2
-    FaultHandler_AFE_MCU(&OVP_Pair, &LEDB, &ClearBits, Cell_VMax);          //Priority 1
-
-    //----------------------------------------------------------------------
-    //Now deal with the outcome of the faults:
-
-    if(Flag_USRRST)
-    {   Flag_USRRST=false;  }
-
-    //Protections which inhibit CHG FET:
-    if(OVP_Pair.State==TRIPPED)
-    {   FETBits &= ~BIT0;                   }
-    else if(OVP_Pair.State==CLEARED)
-    {   FETBits |= BIT0;                    }
-
-    //Protections which inhibit DSG FET:
-
-    if(MCPC_Pair.State==TRIPPED || BCPC_Pair.State==TRIPPED || MCPD_Pair.State==TRIPPED || BCPD_Pair.State==TRIPPED ||
-       OCPD_Pair.State==TRIPPED || SCPD_Pair.State==TRIPPED || UVP_Pair.State==TRIPPED)
-    {   FETBits &= ~BIT1;                   }
+    Update_Measurements();
 
-    if(MCPC_Pair.State==CLEARED && BCPC_Pair.State==CLEARED && MCPD_Pair.State==CLEARED && BCPD_Pair.State==CLEARED &&
-       OCPD_Pair.State==CLEARED && SCPD_Pair.State==CLEARED && UVP_Pair.State==CLEARED)
-    {   FETBits |= BIT1;                    }
+    if(GetBit_CCReady())
+    {   SOC_Update(IMeasured);
+        SOH_Update(IMeasured);
+        History_Update(IMeasured);  }
+}
 
-    //If you do the same type of statement for things that trip both FETs you will override previous
-    //states, so include the statements for things like OTPB in BOTH CHG and DSG inhibit statements
+//----------------------------------------------------------------------------------------------------
+// Deal with the faults of one pass one by one, then adjust FETs accordingly. The fast pass only has
+// SYS_STAT and the current to go on, the rest of the inputs are from the last cycle, only the clear
+// qualifiers of OV and UV use them.
+void Fault_Handler(FaultPass_t pass)
+{
+    signed int Inputs[FAULT_NUM_INPUTS];
+    uint8_t CT;
+
+    //Everything the MCU thresholds in Fault_Table compare against:
+    Inputs[FAULT_IN_NONE] = 0;
+    Inputs[FAULT_IN_CURRENT] = IMeasured;
+    Inputs[FAULT_IN_VCELL_MIN] = Cell_VMin;
+    Inputs[FAULT_IN_VCELL_MAX] = Cell_VMax;
+    Inputs[FAULT_IN_BUSFAIL] = I2C_Get_FailStreak();
+    for(CT=0; CT<AFE_NUM_TS; CT++)
+    {   Inputs[FAULT_IN_TS+CT] = Get_Temp_dC(CT);   }
+
+    //One pass over the protections, priority from lowest to highest for LED indication. Faults
+    //that are lower priority will be masked from user LED indication by higher priority faults, but
+    //will still properly protect when tripped. What comes back is the FETs none of them hold open:
+    NewTrips = Fault_Tripped;
+    FETBits = Fault_Update(pass, Inputs, Flag_USRRST, &LEDB, &ClearBits);
+    NewTrips = Fault_Tripped & ~NewTrips;
+    if(pass==FAULT_PASS_FAST)
+    {   Latency_Mark(LAT_DECIDE);   }
+
+    //A reset press goes to every row, so it is only used up by the last pass of the cycle:
+    if(Flag_USRRST && pass!=FAULT_PASS_FAST)
+    {   Flag_USRRST=false;  }
 
     ///For AFE Drive protection Latching, write 1 to clear if respective faults were recovered from
     //if(ClearBits!=0x00)
     //{   Clear_FaultBits(ClearBits);
     //    ClearBits=0x00;                     }
 
-    //If there is a change in CHG or DSG, set the respective FET bits:
-    if(FETBits!=PrevFETBits)
-    {   Set_CHG_DSG_Bits(FETBits);
-        PrevFETBits=FETBits;                }
+    //Stage the CHG and DSG FET bits, the register shadow only writes them out if they changed.
+    //Both stay open while the CC offset is being measured:
+    Set_CHG_DSG_Bits(CCOffset_Active() ? 0 : FETBits);
 
     //Also clear the fault LED upon recover from all faults:
     if(FETBits==(BIT1+BIT0))
@@ -374,6 +429,7 @@ void Fault_Handler(void)
 #pragma vector=PORT1_VECTOR
 __interrupt void Port_1(void)
 {
+    Latency_Alert();                            // Stamp the edge before anything else
     P1IFG &= ~BIT1;                             // Clear P1.1 IFG
     DBUGOUT_POUT |= DBUGOUT_2;
     Flag_AFEALRT=true;
@@ -408,6 +464,7 @@ __interrupt void TIMER0_B1_ISR(void)
             LEDB.Blink_PeriodCT++;
             Cycle_Period_CT++;
             SYS_Checkin_CT++;
+            NFC_Refresh_CT++;
             Flag_LEDBTN = true;
             DBUGOUT_POUT &= ~DBUGOUT_1;
             __bic_SR_register_on_exit(LPM0_bits);
@@ -0,0 +1,117 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Balance_Handler.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Cell balancing scheduler, picks the cells to bleed from the pack statistics and stages CEL_BAL
+----------------------------------------------------------------------------------------------------*/
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+#include "BatteryData.h"
+#include "Balance_Handler.h"
+
+//----------------------------------------------------------------------------------------------------
+// Balance_Update runs once per alert cycle after the snapshot. Bleed current through the input
+// filter resistors pulls the reading of a bled cell down and its neighbours up, so the cells are
+// only picked from a snapshot taken after BAL_SETTLE_CYCLES with CEL_BAL cleared, and everything
+// is cleared again after BAL_ON_CYCLES. Picking goes from the highest cell down and skips a cell
+// when the cell above or below it in the stack is already picked, which covers the BQ769x0 rule
+// against balancing adjacent cells (inputs shorted in between still share a node). Cells that were
+// already bleeding only stop once they are within BAL_STOP_mV, so the set does not chatter.
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+static uint16_t BalCells = 0;               //Pack cells picked in the last round
+static bool Bleeding = false;
+static uint8_t Bal_CT = 0;
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static uint16_t Balance_Select(uint16_t prev);
+
+//------------------------------------------------------//--------------------------------------------
+// enable=false stops any bleeding at once and keeps it off
+void Balance_Update(bool enable)
+{
+    Bal_CT++;
+
+    if(Bleeding)
+    {
+        if(Bal_CT>=BAL_ON_CYCLES || !enable)
+        {   Set_CellBal(0);
+            Bleeding = false;
+            Bal_CT = 0;         }
+        return;
+    }
+
+    if(Bal_CT<BAL_SETTLE_CYCLES)
+    {   return;     }
+    Bal_CT = 0;
+
+    BalCells = enable ? Balance_Select(BalCells) : 0;
+    if(BalCells)
+    {   Set_CellBal(BalCells);
+        Bleeding = true;        }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Pack cells picked in the last round, bit 0 is pack cell 0
+uint16_t Balance_Get_Cells(void)
+{   return BalCells;    }
+
+//----------------------------------------------------------------------------------------------------
+// True while CEL_BAL is set and the cell readings carry bleed current
+bool Balance_Bleeding(void)
+{   return Bleeding;    }
+
+//----------------------------------------------------------------------------------------------------
+static uint16_t Balance_Select(uint16_t prev)
+{
+    unsigned int Start_mV = PackStats.Min_mV + BAL_START_mV;
+    unsigned int Stop_mV = PackStats.Min_mV + BAL_STOP_mV;
+    unsigned int Max_mV;
+    unsigned int mV;
+    uint16_t Want = 0;
+    uint16_t Picked = 0;
+    uint16_t Bit;
+    uint8_t MaxCell;
+    uint8_t CT;
+
+    if(PackStats.Min_mV<BAL_MIN_mV)
+    {   return 0;   }
+
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {
+        Bit = 1<<CT;
+        mV = Get_VCell_mV(CT);
+        if(mV>Start_mV || ((prev & Bit) && mV>Stop_mV))
+        {   Want |= Bit;    }
+    }
+
+    while(Want)
+    {
+        Max_mV = 0;
+        MaxCell = 0;
+        for(CT=0; CT<PACK_NUM_CELLS; CT++)
+        {
+            if(!(Want & (1<<CT)))
+            {   continue;   }
+            mV = Get_VCell_mV(CT);
+            if(mV>=Max_mV)
+            {   Max_mV = mV;
+                MaxCell = CT;   }
+        }
+
+        Bit = 1<<MaxCell;
+        Want &= ~Bit;
+        if(!(Picked & ((Bit<<1) | (Bit>>1))))
+        {   Picked |= Bit;  }
+    }
+
+    return Picked;
+}
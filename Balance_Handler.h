@@ -0,0 +1,24 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Balance_Handler.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Cell balancing scheduler, picks the cells to bleed from the pack statistics and stages CEL_BAL
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef BALANCE_HANDLER_H
+#define BALANCE_HANDLER_H
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void Balance_Update(bool enable);
+uint16_t Balance_Get_Cells(void);
+bool Balance_Bleeding(void);
+
+#endif
@@ -14,23 +14,31 @@
 #include <stdbool.h>
 #include "Constants.h"
 #include "I2C_Handler.h"
+#include "System.h"
+#include "AFE_Shadow.h"
 #include "BatteryData.h"
 #include "UART_Interface.h"
 
 //----------------------------------------------------------------------------------------------------
 // Constants
-const unsigned char NUMCELLS = 8;
+// AFE input of each cell in the pack (Constants.h), cell data is stored and walked in this order
+static const uint8_t CellPos[PACK_NUM_CELLS] = PACK_CELL_POSITIONS;
+
+// TS counts to 0.1C every TS_LUT_STEP counts from 0, for the thermistor in Constants.h. Interpolated
+// between points this stays within 0.5C from -30C to 100C. Clamped to -40C and 125C, so an open
+// thermistor reads cold and a shorted one hot.
+#define TS_LUT_SHIFT            8
+#define TS_LUT_STEP             (1<<TS_LUT_SHIFT)
+#define TS_LUT_POINTS           35
+static const int16_t TSTable_dC[TS_LUT_POINTS] =
+    {1250, 1250, 1191, 1005,  879,  784,  707,  643,  587,  537,  492,  451,  412,  376,  342,  309,
+      277,  246,  216,  186,  156,  126,   96,   65,   34,    1,  -34,  -70, -110, -155, -206, -268,
+     -351, -400, -400};
 
 //----------------------------------------------------------------------------------------------------
 // Enumerations and Defines
 enum CellGroup {GroupNull=0, GroupA=1, GroupB=2, GroupC=3 };
-#define ONEGROUP 10
-// This array defines which cells actually contain valid data and the number of cells in use:
-const uint8_t NumPositions = 10;
-const uint8_t NumCells = 8;
-// Cell AFE Position:      CELL1 CELL2 CELL3 CELL4  CELL5 CELL6 CELL7 CELL8 CELL9  CELL10
-const bool CellActive[] = {true, true, true, false, true, true, true, true, false, true};
-//const unsigned int
+#define ONEGROUP (AFE_GROUP_POSITIONS*2)
 
 
 
@@ -50,56 +58,233 @@ static uint8_t UVDD_BITS;
 static uint8_t Config_Protect3;
 
 unsigned char StatReg;
-unsigned int CellADCVals[15];
+unsigned int CellADCVals[PACK_NUM_CELLS];
+unsigned int VBattADC = 0;
 unsigned int TempADCVals[3];
+signed int TempVals_dC[AFE_NUM_TS];
 signed int CCVal = 0;
-unsigned char CellIndex=0;
 
+//ADC trim read from the AFE at init. GAIN is kept as mV/LSB in Q16 so a conversion is a single
+//16x16 multiply (MPY32) and a shift. Until the trim is read the nominal 382uV/LSB, 0mV is used.
+static unsigned int ADCGain_Q16 = ((ADC_GAIN_NOMINAL_uV*65536UL)+500)/1000;
+static int8_t ADCOffset_mV = 0;
+
+BQSnapshot_t Snapshot;
+PackStats_t PackStats;
+static I2CTrans_t SnapshotTrans;
+
+//NTP5312 configuration area and the number of reads of it that completed. NFCBusy is cleared from
+//the ISR when the read is over, however it ended.
+uint8_t NFC_CfgBuf[NFC_CFG_BYTES];
+unsigned int NFC_Read_CT = 0;
+static I2CTrans_t NFCTrans;
+static volatile bool NFCBusy = false;
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static bool Snapshot_Read(uint8_t reg, uint8_t len);
+static void Decode_Measurements(void);
+static bool Init_ADCTrim(void);
+static void NFC_ReadDone(I2CTrans_t *trans);
+static unsigned int ADC_To_mV(unsigned int adc);
+static signed int TS_To_dC(unsigned int adc);
+
+// Staged in the register shadow, goes out on the next Shadow_Flush() (only if it changed)
 void Set_CHG_DSG_Bits(uint8_t fetbits)
 {
-    //fetbits&=!(BIT7+BIT6+BIT5+BIT4+BIT3+BIT2); // Mask all bits off except
+    fetbits&=(BIT1+BIT0);                                   // Mask all bits off except DSG/CHG
 
-    I2CTXBuf[0]=SETUP_SYS_CTRL2_CHG_DSG_OFF|fetbits;
-    I2C_Write(I2C_BQ769xxADDR, REG_SYS_CTRL2, 1);
+    Shadow_Set(REG_SYS_CTRL2, SETUP_SYS_CTRL2_CHG_DSG_OFF|fetbits);
 }
 
 //----------------------------------------------------------------------------------------------------
 // Configure the BQ769x0 in the desired manner and confirm
 void Init_BMSConfig(void)
 {
+    Shadow_Init();                                          //Start from what the AFE holds now
+    Init_ADCTrim();
+
+    //SYS_CTRL1/2 and PROTECT1-3 are adjacent, so this all goes out as one write on the flush:
+    Shadow_Set(REG_SYS_CTRL1, SETUP_SYS_CTRL1);             //Enable Coulomb Counting and Alert
+    Shadow_Set(REG_SYS_CTRL2, SETUP_SYS_CTRL2_CHG_DSG_OFF); //FETs stay open until Init_App
+    Shadow_Set(REG_PROTECT1, SETUP_PROTECT1);               //Setup OCP and SCP Thresholds
+    Shadow_Set(REG_PROTECT2, SETUP_PROTECT2);
+    Shadow_Set(REG_PROTECT3, SETUP_PROTECT3);
+    //Shadow_Set(REG_OV_TRIP, SETUP_OV_TRIP);
+    //Shadow_Set(REGUV_TRIP, SETUP_UV_TRIP);
 
-    I2CTXBuf[0]=SETUP_SYS_CTRL1;
-    I2CTXBuf[1]=SETUP_SYS_CTRL2;
-    I2C_Write(I2C_BQ769xxADDR, REG_SYS_CTRL1, 2);           //Enable Coulomb Counting and Alert
-
-    __no_operation();
-    __no_operation();
-    __no_operation();
+    Update_SysStat();
+    Clear_SysStat();
+    Shadow_Flush();
 
     I2C_Read(I2C_BQ769xxADDR, REG_SYS_CTRL1, 2);            //Confirm Proper Sys Config
 
-    //I2CTXBuf[0]=SETUP_SYS_CTRL1;
-    //I2C_Write(I2C_BQ769xxADDR, REG_SYS_CTRL1, 1);           //Enable Coulomb Counting and Alert
-    //I2C_Read(I2C_BQ769xxADDR, REG_SYS_CTRL1, 1);            //Confirm Proper Sys Config
-
-    I2CTXBuf[0]=SETUP_PROTECT1;
-    I2CTXBuf[1]=SETUP_PROTECT2;
-    I2CTXBuf[2]=SETUP_PROTECT3;
-    //I2CTXBuf[3]=SETUP_OV_TRIP;
-    //I2CTXBuf[4]=SETUP_UV_TRIP;
-    I2C_Write(I2C_BQ769xxADDR, REG_PROTECT1, 3);           //Setup OCP and SCP Thresholds
-
-    Update_SysStat();
-    Clear_SysStat();
 
     //I2CTXBuf[0]=0x00
     //I2C_Write(I2C_NTP5312ADDR, 0x00, 1);
     //I2C_Read_Ctrl2(I2C_NTP5312ADDR, 0x00, 0x00, 32);            //Confirm Proper Sys Config
     //I2C_Read_Ctrl2(I2C_NTP5312ADDR, 0x00, 0x08, 32);            //Confirm Proper Sys Config
     //I2C_Read_Ctrl2(I2C_NTP5312ADDR, 0x00, 0x10, 32);            //Confirm Proper Sys Config
-    I2C_Read_Ctrl2(I2C_NTP5312ADDR, 0x00, 0x18, 32);            //Confirm Proper Sys Config
+    NFC_Refresh();                                          //NFC config, finishes in the background
+}
+
+//----------------------------------------------------------------------------------------------------
+// Start a read of the NFC configuration area unless the last one is still going. Returns right
+// away, the read goes out one I2C_NTP5312CHUNK at a time whenever no protection transfer is
+// waiting, and NFC_ReadDone runs from the ISR once it is over. A failed read is not retried, the
+// next refresh reads it again.
+void NFC_Refresh(void)
+{
+    if(NFCBusy)
+    {   return;     }
+    NFCBusy = true;
+
+    NFCTrans.Addr = I2C_NTP5312ADDR;
+    NFCTrans.CtrlReg = 0x00;
+    NFCTrans.CtrlReg2 = NFC_CFG_BLOCK;
+    NFCTrans.NumCtrl = 2;
+    NFCTrans.TXBuf = 0;
+    NFCTrans.TXBytes = 0;
+    NFCTrans.RXBuf = NFC_CfgBuf;
+    NFCTrans.RXBytes = NFC_CFG_BYTES;
+    NFCTrans.Prescale = 0;
+    NFCTrans.Prio = I2C_PRIO_BULK;
+    NFCTrans.ChunkLen = I2C_NTP5312CHUNK;
+    NFCTrans.RegShift = I2C_NTP5312REGSHIFT;
+    NFCTrans.Callback = NFC_ReadDone;
+
+    I2C_Submit(&NFCTrans);
+}
+
+//----------------------------------------------------------------------------------------------------
+// From USCIB0_ISR (or the timeout ISR) when the NFC read is over
+static void NFC_ReadDone(I2CTrans_t *trans)
+{
+    if(trans->Result==I2C_OK)
+    {   NFC_Read_CT++;  }
+    NFCBusy = false;
+}
+
+
+//----------------------------------------------------------------------------------------------------
+// Read the factory ADC trim. GAIN is 365uV + ADCGAIN<4:0>, split across ADCGAIN1<3:2> (bits 4:3)
+// and ADCGAIN2<7:5> (bits 2:0). OFFSET is a signed mV value.
+static bool Init_ADCTrim(void)
+{
+    unsigned int Gain_uV;
+    uint8_t Gain1;
+
+    if(!I2C_Read(I2C_BQ769xxADDR, REG_ADCGAIN1, 2))
+    {   return false;   }
+    Gain1 = I2CRXBuf[0];
+    ADCOffset_mV = (int8_t)I2CRXBuf[1];
+
+    if(!I2C_Read(I2C_BQ769xxADDR, REG_ADCGAIN2, 1))
+    {   return false;   }
+    Gain_uV = ADC_GAIN_BASE_uV + (((Gain1 & 0x0C) << 1) | ((I2CRXBuf[0] & 0xE0) >> 5));
+    ADCGain_Q16 = ((Gain_uV*65536UL)+500)/1000;
+
+    return true;
 }
 
+//----------------------------------------------------------------------------------------------------
+// Cell ADC counts to mV with the trim applied, a shorted input can come out below 0 and reads 0
+static unsigned int ADC_To_mV(unsigned int adc)
+{
+    signed long mV;
+
+    mV = (((uint32_t)adc * ADCGain_Q16 + 0x8000) >> 16) + ADCOffset_mV;
+    return (mV<0) ? 0 : (unsigned int)mV;
+}
+
+//----------------------------------------------------------------------------------------------------
+// TS counts to 0.1C, one table read pair and one multiply. The table falls with rising counts, so
+// the step down is taken as a positive number.
+static signed int TS_To_dC(unsigned int adc)
+{
+    unsigned int Idx = adc >> TS_LUT_SHIFT;
+    signed int T0;
+
+    if(Idx>=TS_LUT_POINTS-1)
+    {   return TSTable_dC[TS_LUT_POINTS-1];     }
+
+    T0 = TSTable_dC[Idx];
+    return T0 - (signed int)(((uint32_t)(T0-TSTable_dC[Idx+1]) * (adc & (TS_LUT_STEP-1))) >>
+                             TS_LUT_SHIFT);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Fast half of the snapshot, what the current protections need: SYS_STAT through CC_CFG and then
+// CC_HI/LO, 14 bytes in two bursts instead of 52. All shadowed registers are read so the shadow
+// learns about a FET the AFE dropped by itself before the FETs are flushed.
+bool Update_FastStat(void)
+{
+    bool Result;
+
+    Result = Snapshot_Read(REG_SYS_STAT, SHADOW_LEN) && Snapshot_Read(REG_CCREG, 2);
+
+    //Keep the last good values if a transfer was corrupted
+    if(Result)
+    {   StatReg = Snapshot.SysStat;
+        CCVal = (int16_t)((Snapshot.CC[0] << 8) + Snapshot.CC[1]);
+        Shadow_Sync(&Snapshot.SysStat);                             }
+    return Result;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Bulk half of the snapshot: all cells, VBATT and TS in one auto-incremented burst, so they all come
+// from the same moment in time. Run once the FETs for the fast half are out.
+bool Update_Measurements(void)
+{
+    bool Result;
+
+    Result = Snapshot_Read(REG_VCELL1, REG_CCREG-REG_VCELL1);
+
+    if(Result)
+    {   Decode_Measurements();  }
+    return Result;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Read len registers from reg into their place in Snapshot. Both halves carry protection data, so
+// both go at PROT priority.
+static bool Snapshot_Read(uint8_t reg, uint8_t len)
+{
+    SnapshotTrans.Addr = I2C_BQ769xxADDR;
+    SnapshotTrans.CtrlReg = reg;
+    SnapshotTrans.NumCtrl = 1;
+    SnapshotTrans.TXBuf = 0;
+    SnapshotTrans.TXBytes = 0;
+    SnapshotTrans.RXBuf = (uint8_t *)&Snapshot + (reg-REG_SYS_STAT);
+    SnapshotTrans.RXBytes = len;
+    SnapshotTrans.Prescale = 0;
+    SnapshotTrans.Prio = I2C_PRIO_PROT;
+    SnapshotTrans.ChunkLen = 0;
+    SnapshotTrans.RegShift = 0;
+    SnapshotTrans.Callback = 0;
+
+    return (I2C_Transfer(&SnapshotTrans)==I2C_OK);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Unpack the cells and TS of the snapshot into the same variables the individual Update_ functions
+// fill
+static void Decode_Measurements(void)
+{
+    unsigned int CT;
+
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {   CellADCVals[CT] = (Snapshot.VCell[CellPos[CT]][0] << 8) + Snapshot.VCell[CellPos[CT]][1];  }
+
+    VBattADC = (Snapshot.VBatt[0] << 8) + Snapshot.VBatt[1];
+
+    for(CT=0; CT<3; CT++)
+    {   TempADCVals[CT] = (Snapshot.TS[CT][0] << 8) + Snapshot.TS[CT][1];  }
+    for(CT=0; CT<AFE_NUM_TS; CT++)
+    {   TempVals_dC[CT] = TS_To_dC(TempADCVals[CT]);    }
+
+    Update_PackStats();
+}
 
 //----------------------------------------------------------------------------------------------------
 // Update Status Register
@@ -112,11 +297,11 @@ unsigned char Update_SysStat(void)
 
 //----------------------------------------------------------------------------------------------------
 // Clear the Status Register by setting all bit that were set to 1 back to 1
-// (Which will actually clear them, somewhat confusing)
+// (Which will actually clear them, somewhat confusing). Only the bits seen in the last read are
+// cleared so a fault that lands in between is not lost. Staged, goes out on Shadow_Flush().
 void Clear_SysStat(void)
 {
-    I2CTXBuf[0]=0xFF;
-    I2C_Write(I2C_BQ769xxADDR, REG_SYS_STAT, 1);     //Clear the System Status Register
+    Shadow_ClearStat(StatReg);                      //Clear the System Status Register
 }
 
 //----------------------------------------------------------------------------------------------------
@@ -124,8 +309,7 @@ void Clear_SysStat(void)
 // (Which will actually clear it, somewhat confusing)
 void Clear_CCReady(void)
 {
-    I2CTXBuf[0]=BIT7;
-    I2C_Write(I2C_BQ769xxADDR, REG_SYS_STAT, 1);     //Clear the System Status Register
+    Shadow_ClearStat(BIT7);                         //Clear the System Status Register
 }
 
 //----------------------------------------------------------------------------------------------------
@@ -144,8 +328,7 @@ bool Get_FaultBit(uint8_t bit)
 //----------------------------------------------------------------------------------------------------
 void Clear_FaultBits(uint8_t bits)
 {
-    I2CTXBuf[0]=bits;
-    I2C_Write(I2C_BQ769xxADDR, REG_SYS_STAT, 1);
+    Shadow_ClearStat(bits);
 }
 
 //----------------------------------------------------------------------------------------------------
@@ -153,128 +336,203 @@ unsigned char GetByte_SysStat()
 {   return StatReg; }
 
 //----------------------------------------------------------------------------------------------------
-// Update Cell Voltages from I2C Buffer
+// Update the cells of one group (5 AFE inputs) with a separate read, normally the snapshot covers
+// all of them
 void Update_VCells(unsigned char Group)
 {
-    unsigned int GroupReg;
-
-    switch (Group)
-    {
-        case GroupA:
-        {   CellIndex=0;
-            GroupReg=REG_VCELL1;
-            break;              }
-        case GroupB:
-        {   CellIndex=5;
-            GroupReg=REG_VCELL6;
-            break;              }
-        case GroupC:
-        {   CellIndex=10;
-            GroupReg=REG_VCELL11;
-            break;              }
-        case GroupNull:
-        {   break;              }
-        default:
-        {   break;              }
-    }
+    uint8_t Base;
+    uint8_t Idx;
+    uint8_t CT;
 
-    I2C_Read(I2C_BQ769xxADDR, GroupReg, ONEGROUP);
+    if(Group==GroupNull || Group>AFE_NUM_GROUPS)
+    {   return;     }
+    Base = (Group-GroupA)*AFE_GROUP_POSITIONS;
 
-    CellADCVals[CellIndex] = (I2CRXBuf[0] << 8) + I2CRXBuf[1];
-    CellADCVals[CellIndex+1] = (I2CRXBuf[2] << 8) + I2CRXBuf[3];
-    CellADCVals[CellIndex+2] = (I2CRXBuf[4] << 8) + I2CRXBuf[5];
-    CellADCVals[CellIndex+3] = (I2CRXBuf[6] << 8) + I2CRXBuf[7];
-    CellADCVals[CellIndex+4] = (I2CRXBuf[8] << 8) + I2CRXBuf[9];
-
-    //printf("CellADCVals: "); unsigned int i=0; for (i=0; i<NUMCELLS; i++) printf("%i,", CellADCVals[i]); printf("\n");
+    I2C_Read(I2C_BQ769xxADDR, REG_VCELL1+2*Base, ONEGROUP);
 
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {
+        if(CellPos[CT]>=Base && CellPos[CT]<Base+AFE_GROUP_POSITIONS)
+        {   Idx = (CellPos[CT]-Base)*2;
+            CellADCVals[CT] = (I2CRXBuf[Idx] << 8) + I2CRXBuf[Idx+1];   }
+    }
 }
 
 //----------------------------------------------------------------------------------------------------
-//Get
-void Set_CellBal(unsigned char Group, unsigned char Cell, bool Enable)
+// Stage CEL_BAL1-3 from a mask of pack cells (bit 0 is pack cell 0), each cell lands on the bit of
+// its AFE input. The shadow only writes the registers that changed on the next flush.
+void Set_CellBal(uint16_t cells)
 {
-    char GroupReg;
+    uint8_t GroupBits[AFE_NUM_GROUPS] = {0};
+    uint8_t CT;
 
-    switch (Group)
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
     {
-        case GroupA:
-        {   GroupReg=REG_CEL_BAL1;
-            break;              }
-        case GroupB:
-        {   GroupReg=REG_CEL_BAL2;
-            break;              }
-        case GroupC:
-        {   GroupReg=REG_CEL_BAL3;
-            break;              }
-        case GroupNull:
-        {   break;              }
-        default:
-        {   break;              }
+        if(cells & (1<<CT))
+        {   GroupBits[CellPos[CT]/AFE_GROUP_POSITIONS] |= 1 << (CellPos[CT]%AFE_GROUP_POSITIONS);  }
     }
 
-    if(Enable==true)
-    {   I2CTXBuf[0]=0x01;       }
-    if(Enable==false)
-    {   I2CTXBuf[0]=0x00;       }
-    I2C_Write(I2C_BQ769xxADDR, GroupReg, ONEGROUP);
+    for(CT=0; CT<AFE_NUM_GROUPS; CT++)
+    {   Shadow_Set(REG_CEL_BAL1+CT, GroupBits[CT]);     }
 }
 
 //----------------------------------------------------------------------------------------------------
-// Get Cell Voltage in ADC Counts
+// Get Cell Voltage in ADC Counts, CellNum is the cell in the pack (0 to PACK_NUM_CELLS-1)
 unsigned int Get_VCell_ADC(unsigned char CellNum)
 {
     return CellADCVals[CellNum];
 }
 
 //----------------------------------------------------------------------------------------------------
-// Get Cell Voltage in ADC Counts
+// Highest cell in mV
 unsigned int Get_VCell_Max(void)
 {
     unsigned int Max=0;
     unsigned int CT=0;
 
-    for(CT=0; CT<NumPositions; CT++)
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
     {
-        if(CellActive[CT]==true)
-        {
-            if(CellADCVals[CT]>Max)
-            {   Max=CellADCVals[CT];    }
-        }
+        if(CellADCVals[CT]>Max)
+        {   Max=CellADCVals[CT];    }
     }
-    return Max;
+    return ADC_To_mV(Max);
 }
 
 //----------------------------------------------------------------------------------------------------
-// Get Cell Voltage in ADC Counts
+// Lowest cell in mV
 unsigned int Get_VCell_Min(void)
 {
-    unsigned int Min=9999;
+    unsigned int Min=0x3FFF;                //ADC full scale
     unsigned int CT=0;
 
-    for(CT=0; CT<NumPositions; CT++)
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {
+        if(CellADCVals[CT]<Min)
+        {   Min=CellADCVals[CT];    }
+    }
+    return ADC_To_mV(Min);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Cell voltage in mV
+unsigned int Get_VCell_mV(unsigned char CellNum)
+{
+    return ADC_To_mV(CellADCVals[CellNum]);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Min, max and their cells, sum, mean and spread of the cell voltages in a single pass. The pass
+// stays in ADC counts, the trim is a positive gain plus an offset so the extremes are the same cells
+// either way, and only Min, Max and the sum are converted at the end. The sum is gain*sum+N*offset,
+// within N/2 mV of adding up the converted cells. The sum of counts runs to 18 bits, so the gain is
+// applied to its upper and lower part separately to keep every product in 32 bits.
+void Update_PackStats(void)
+{
+    unsigned int Min = CellADCVals[0];
+    unsigned int Max = CellADCVals[0];
+    unsigned long Sum = CellADCVals[0];
+    unsigned int ADC;
+    uint8_t MinCell = 0;
+    uint8_t MaxCell = 0;
+    uint8_t CT;
+    signed long mV;
+
+    for(CT=1; CT<PACK_NUM_CELLS; CT++)
     {
-        if(CellActive[CT]==true)
-        {
-            if(CellADCVals[CT]<Min)
-            {   Min=CellADCVals[CT];    }
-        }
+        ADC = CellADCVals[CT];
+        Sum += ADC;
+        if(ADC<Min)
+        {   Min = ADC;
+            MinCell = CT;   }
+        if(ADC>Max)
+        {   Max = ADC;
+            MaxCell = CT;   }
     }
-    return Min;
+
+    mV = (ADCGain_Q16*(Sum>>8) + ((ADCGain_Q16*(Sum&0xFF) + 0x8000)>>8)) >> 8;
+    mV += (signed long)PACK_NUM_CELLS*ADCOffset_mV;
+    PackStats.Min_mV = ADC_To_mV(Min);
+    PackStats.Max_mV = ADC_To_mV(Max);
+    PackStats.MinCell = MinCell;
+    PackStats.MaxCell = MaxCell;
+    PackStats.Sum_mV = (mV<0) ? 0 : (unsigned long)mV;
+    PackStats.Mean_mV = PackStats.Sum_mV/PACK_NUM_CELLS;
+    PackStats.Delta_mV = PackStats.Max_mV-PackStats.Min_mV;
 }
 
+#ifdef PACKSTATS_BENCH
+//----------------------------------------------------------------------------------------------------
+// MCLK cycles per call: [0] Get_VCell_Max()+Get_VCell_Min(), [1] Update_PackStats(), [2] the empty
+// loop, which has already been taken out of the other two
+unsigned int PackStats_BenchCycles[3];
+static volatile unsigned int BenchSink;
+
 //----------------------------------------------------------------------------------------------------
-// Compute Cell Voltage in Decimal
-float Get_VCell_Dec(unsigned char CellNum)
+// Time both ways of getting the cell extremes over PACKSTATS_BENCH_RUNS calls on Timer1_B. Runs with
+// interrupts off so nothing else lands in the measurement.
+static unsigned int PackStats_Time(uint8_t which)
 {
-    return CellADCVals[CellNum]*0.000382;
+    unsigned int Start;
+    unsigned int CT;
+
+    Start = Timebase_Now();
+    for(CT=0; CT<PACKSTATS_BENCH_RUNS; CT++)
+    {
+        if(which==0)
+        {   BenchSink = Get_VCell_Max();
+            BenchSink = Get_VCell_Min();    }
+        else if(which==1)
+        {   Update_PackStats();     }
+    }
+    return (uint16_t)(Timebase_Now() - Start);
+}
+
+//----------------------------------------------------------------------------------------------------
+void PackStats_Bench(void)
+{
+    unsigned int Ticks[3];
+    uint8_t CT;
+
+    __disable_interrupt();
+    for(CT=0; CT<3; CT++)
+    {   Ticks[CT] = PackStats_Time(CT);     }
+    __enable_interrupt();
+
+    for(CT=0; CT<3; CT++)
+    {   PackStats_BenchCycles[CT] = ((unsigned long)(Ticks[CT] - (CT<2 ? Ticks[2] : 0)) *
+                                     TIMEBASE_CYCLES_PER_TICK) / PACKSTATS_BENCH_RUNS;      }
+}
+#endif
+
+//----------------------------------------------------------------------------------------------------
+void Update_VBatt(void)
+{
+    I2C_Read(I2C_BQ769xxADDR, REG_VBATT, 2);
+    VBattADC = (I2CRXBuf[0] << 8) + I2CRXBuf[1];
+}
+
+//----------------------------------------------------------------------------------------------------
+unsigned int Get_VBatt_ADC(void)
+{
+    return VBattADC;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Pack voltage in mV, VBAT = 4 x GAIN x ADC + (cells x OFFSET). The x4 is folded into the shift so
+// the product still fits in 32 bits.
+unsigned int Get_VBatt_mV(void)
+{
+    signed long mV;
+
+    mV = (((uint32_t)VBattADC * ADCGain_Q16 + 0x2000) >> 14) + PACK_NUM_CELLS*ADCOffset_mV;
+    return (mV<0) ? 0 : (unsigned int)mV;
 }
 
 //----------------------------------------------------------------------------------------------------
 int Update_CCReg(void)
 {
     I2C_Read(I2C_BQ769xxADDR, REG_CCREG, 2);
-    CCVal = (I2CRXBuf[0] << 8) + I2CRXBuf[1];
+    CCVal = (int16_t)((I2CRXBuf[0] << 8) + I2CRXBuf[1]);
     //if(1<<15&CCVal)
     //{   CCVal=-1*((~CCVal)+1);      }
     return CCVal;
@@ -291,5 +549,22 @@ void Update_TSReg()
     I2C_Read(I2C_BQ769xxADDR, REG_TS1, 4);
     TempADCVals[0] = (I2CRXBuf[0] << 8) + I2CRXBuf[1];
     TempADCVals[1] = (I2CRXBuf[2] << 8) + I2CRXBuf[3];
+    TempVals_dC[0] = TS_To_dC(TempADCVals[0]);
+#if AFE_NUM_TS>1
+    TempVals_dC[1] = TS_To_dC(TempADCVals[1]);
+#endif
+}
+
+//----------------------------------------------------------------------------------------------------
+unsigned int GetNum_TS_Cnt(unsigned char TempNum)
+{
+    return TempADCVals[TempNum];
+}
+
+//----------------------------------------------------------------------------------------------------
+// Temperature in 0.1C at TS1-TS3 (TempNum 0 to AFE_NUM_TS-1) from the last snapshot
+signed int Get_Temp_dC(unsigned char TempNum)
+{
+    return TempVals_dC[TempNum];
 }
 
@@ -20,6 +20,44 @@
 //----------------------------------------------------------------------------------------------------
 // Enumerations
 
+//----------------------------------------------------------------------------------------------------
+// Structs
+
+//----------------------------------------------------------------------------------------------------
+// Raw image of the BQ769x0 register map from SYS_STAT (0x00) through CC_LO (0x33), filled by one
+// auto-incremented burst read. Every member is a byte or byte array so the struct has no padding
+// and lines up with the register addresses. Multi-byte values are big endian (HI byte first).
+typedef struct
+{
+    uint8_t SysStat;                //0x00
+    uint8_t CellBal[3];             //0x01-0x03
+    uint8_t SysCtrl[2];             //0x04-0x05
+    uint8_t Protect[3];             //0x06-0x08
+    uint8_t OVTrip;                 //0x09
+    uint8_t UVTrip;                 //0x0A
+    uint8_t CCCfg;                  //0x0B
+    uint8_t VCell[15][2];           //0x0C-0x29
+    uint8_t VBatt[2];               //0x2A-0x2B
+    uint8_t TS[3][2];               //0x2C-0x31
+    uint8_t CC[2];                  //0x32-0x33
+} BQSnapshot_t;
+
+#define SNAPSHOT_LEN            (REG_CCREG+2-REG_SYS_STAT)
+
+//----------------------------------------------------------------------------------------------------
+// Cell statistics, refreshed in one pass over the cells every time a snapshot is decoded. Balancing,
+// imbalance protection and telemetry read from here instead of scanning the cells again.
+typedef struct
+{
+    unsigned int Min_mV;
+    unsigned int Max_mV;
+    uint8_t MinCell;                //Pack cell index (0 to PACK_NUM_CELLS-1)
+    uint8_t MaxCell;
+    unsigned long Sum_mV;
+    unsigned int Mean_mV;
+    unsigned int Delta_mV;          //Max_mV-Min_mV
+} PackStats_t;
+
 //----------------------------------------------------------------------------------------------------
 // Function Prototypes
 
@@ -33,6 +71,11 @@ uint8_t Compose_Protect3();
 void Init_BMSProtect(void);
 bool Check_BMSConfig(void);
 bool Check_BMSProtect(void);
+//------------------------------------------------------------------------------------------
+// Measurement snapshot, fast half (SYS_STAT and CC) then bulk half (cells, VBATT and TS)
+bool Update_FastStat(void);
+bool Update_Measurements(void);
+
 //------------------------------------------------------------------------------------------
 // Status Register
 unsigned char Update_SysStat(void);
@@ -57,22 +100,39 @@ void Update_VCells(unsigned char Group);
 unsigned int Get_VCell_ADC(unsigned char CellNum);
 unsigned int Get_VCell_Max(void);
 unsigned int Get_VCell_Min(void);
-float Get_VCell_Dec(unsigned char CellNum);
+unsigned int Get_VCell_mV(unsigned char CellNum);
 void Update_VBatt(void);
+unsigned int Get_VBatt_ADC(void);
+unsigned int Get_VBatt_mV(void);
+void Update_PackStats(void);
+void PackStats_Bench(void);
 
 //------------------------------------------------------------------------------------------
 // Coulomb Counter registers
 int Update_CCReg(void);
 int Get_CCVal_ADC(void);
-float Get_CCVal_Dec(void);
 
 //------------------------------------------------------------------------------------------
 // Temp Sensor registers
 void Update_TSReg(void);
 unsigned int GetNum_TS_Cnt(unsigned char TempNum);
+signed int Get_Temp_dC(unsigned char TempNum);
 
 //------------------------------------------------------------------------------------------
 // Cell balance registers
-void Set_CellBal(unsigned char Group, unsigned char Cell, bool Enable);
+void Set_CellBal(uint16_t cells);
+
+//------------------------------------------------------------------------------------------
+// NTP5312 configuration area, read in the background
+void NFC_Refresh(void);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern PackStats_t PackStats;
+extern uint8_t NFC_CfgBuf[NFC_CFG_BYTES];
+extern unsigned int NFC_Read_CT;
+#ifdef PACKSTATS_BENCH
+extern unsigned int PackStats_BenchCycles[3];
+#endif
 
 #endif
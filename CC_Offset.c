@@ -0,0 +1,176 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: CC_Offset.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Coulomb counter offset, measured with both FETs open and kept in FRAM per temperature bin
+----------------------------------------------------------------------------------------------------*/
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+#include "System.h"
+#include "BatteryData.h"
+#include "CC_Offset.h"
+
+//----------------------------------------------------------------------------------------------------
+// With both FETs open no current can flow, so whatever the CC reads is its own offset. While a
+// calibration runs CCOffset_Active() is true and Fault_Handler keeps both FETs open, the first
+// CCOFS_SETTLE samples are dropped and the next CCOFS_SAMPLES are averaged. The average goes into
+// the bin of the present TS1 temperature, the first one as is and later ones through a first order
+// filter. Without an offset for the present bin the nearest calibrated bin stands in. A board
+// without a thermistor on TS1 simply always lands in the same bin.
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+enum CCOfsState {CCOFS_IDLE, CCOFS_SETTLING, CCOFS_SAMPLING};
+// 10C bins, bin 0 is below -10C and bin 7 from 50C up
+#define CCOFS_BIN_dC            100
+#define CCOFS_BIN0_dC           -200
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+#pragma PERSISTENT(CCOffset_Store);
+CCOffsetStore_t CCOffset_Store = {{0}, 0};
+
+static uint8_t State = CCOFS_IDLE;
+static uint8_t Sample_CT = 0;
+static int32_t Sample_Sum = 0;
+static unsigned int Rest_CT = 0;
+static uint32_t Since_CT = 0;
+static signed int Offset = 0;
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static uint8_t CCOffset_Bin(void);
+static signed int CCOffset_Lookup(uint8_t bin);
+static void CCOffset_Save(uint8_t bin, int16_t avg_Q4);
+
+//------------------------------------------------------//--------------------------------------------
+// Start with a calibration, Init_App keeps the FETs open while it runs
+void Init_CCOffset(void)
+{
+    State = CCOFS_SETTLING;
+    Sample_CT = 0;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Called once per alert cycle with CC_READY set, cc is the raw sample and fetBits what the fault
+// handlers want the FETs to be (BIT1 DSG, BIT0 CHG). Also refreshes what CCOffset_Get() returns.
+void CCOffset_Update(signed int cc, uint8_t fetBits)
+{
+    uint8_t Bin = CCOffset_Bin();
+    signed int I;
+
+    Offset = CCOffset_Lookup(Bin);
+    I = cc - Offset;
+
+    switch(State)
+    {
+    case CCOFS_IDLE:
+        if(Since_CT<CCOFS_PERIOD_CYCLES)
+        {   Since_CT++;     }
+
+        if(I<SOC_REST_COUNTS && I>-SOC_REST_COUNTS)
+        {
+            if(Rest_CT<CCOFS_REST_CYCLES)
+            {   Rest_CT++;  }
+        }
+        else
+        {   Rest_CT = 0;    }
+
+        //Due on schedule or in a new temperature bin, only once nothing is drawn from the pack, or
+        //straight away if the faults already hold both FETs open:
+        if((Since_CT>=CCOFS_PERIOD_CYCLES || !(CCOffset_Store.ValidMask & (1<<Bin))) &&
+           (Rest_CT>=CCOFS_REST_CYCLES || (fetBits&(BIT1+BIT0))==0))
+        {   State = CCOFS_SETTLING;
+            Sample_CT = 0;              }
+        break;
+
+    case CCOFS_SETTLING:
+        Sample_CT++;
+        if(Sample_CT>=CCOFS_SETTLE)
+        {   State = CCOFS_SAMPLING;
+            Sample_CT = 0;
+            Sample_Sum = 0;             }
+        break;
+
+    case CCOFS_SAMPLING:
+        Sample_Sum += cc;
+        Sample_CT++;
+        if(Sample_CT>=CCOFS_SAMPLES)
+        {   CCOffset_Save(Bin, (int16_t)(Sample_Sum*16/CCOFS_SAMPLES));
+            Offset = CCOffset_Lookup(Bin);
+            State = CCOFS_IDLE;
+            Since_CT = 0;
+            Rest_CT = 0;                                                }
+        break;
+
+    default:
+        State = CCOFS_IDLE;
+        break;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+// True while the FETs must stay open for a calibration
+bool CCOffset_Active(void)
+{   return State!=CCOFS_IDLE;   }
+
+//----------------------------------------------------------------------------------------------------
+// Offset in CC counts to subtract from each raw sample
+signed int CCOffset_Get(void)
+{   return Offset;  }
+
+//----------------------------------------------------------------------------------------------------
+static uint8_t CCOffset_Bin(void)
+{
+    signed int Bin = (Get_Temp_dC(TS_BATTERY) - CCOFS_BIN0_dC) / CCOFS_BIN_dC;
+
+    if(Bin<0)
+    {   return 0;   }
+    if(Bin>CCOFS_NUM_BINS-1)
+    {   return CCOFS_NUM_BINS-1;    }
+    return Bin;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Rounded offset of the bin, or of the nearest calibrated one, 0 before the first calibration
+static signed int CCOffset_Lookup(uint8_t bin)
+{
+    int8_t Found = -1;
+    int16_t Q4;
+    uint8_t Dist;
+
+    for(Dist=0; Dist<CCOFS_NUM_BINS && Found<0; Dist++)
+    {
+        if(bin>=Dist && (CCOffset_Store.ValidMask & (1<<(bin-Dist))))
+        {   Found = bin-Dist;   }
+        else if(bin+Dist<CCOFS_NUM_BINS && (CCOffset_Store.ValidMask & (1<<(bin+Dist))))
+        {   Found = bin+Dist;   }
+    }
+
+    if(Found<0)
+    {   return 0;   }
+
+    Q4 = CCOffset_Store.Offset_Q4[Found];
+    return (Q4<0) ? -((8-Q4)>>4) : (Q4+8)>>4;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void CCOffset_Save(uint8_t bin, int16_t avg_Q4)
+{
+    uint8_t Prot = FRAM_Write_Enable();
+
+    if(CCOffset_Store.ValidMask & (1<<bin))
+    {   CCOffset_Store.Offset_Q4[bin] += (avg_Q4 - CCOffset_Store.Offset_Q4[bin]) /
+                                         (1<<CCOFS_FILTER_SHIFT);                    }
+    else
+    {   CCOffset_Store.Offset_Q4[bin] = avg_Q4;
+        CCOffset_Store.ValidMask |= 1<<bin;     }
+
+    FRAM_Write_Restore(Prot);
+}
@@ -0,0 +1,45 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: CC_Offset.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Coulomb counter offset, measured with both FETs open and kept in FRAM per temperature bin
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef CC_OFFSET_H
+#define CC_OFFSET_H
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define CCOFS_NUM_BINS          8
+
+//----------------------------------------------------------------------------------------------------
+// Structs
+
+//----------------------------------------------------------------------------------------------------
+// FRAM copy of the offsets in 1/16 CC LSB, one per TS1 temperature bin. A bin's bit in ValidMask is
+// only set once its offset has been written, so a reset in the middle of a save loses nothing.
+typedef struct
+{
+    int16_t Offset_Q4[CCOFS_NUM_BINS];
+    uint8_t ValidMask;
+} CCOffsetStore_t;
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void Init_CCOffset(void);
+void CCOffset_Update(signed int cc, uint8_t fetBits);
+bool CCOffset_Active(void);
+signed int CCOffset_Get(void);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern CCOffsetStore_t CCOffset_Store;
+
+#endif
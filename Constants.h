@@ -17,10 +17,62 @@
 //----------------------------------------------------------------------------------------------------
 //enum BOOLEAN {TRUE, FALSE};
 
+//----------------------------------------------------------------------------------------------------
+// Pack topology. The BQ76920/30/40 have 1/2/3 groups of 5 cell inputs, PACK_CELL_POSITIONS lists
+// the inputs (0 based, ascending) that carry a cell, unused inputs are shorted on the board.
+// Uncomment BMS_PACK_15S for the 15 cell BQ76940 pack.
+//#define BMS_PACK_15S
+#ifdef BMS_PACK_15S
+#define AFE_NUM_GROUPS          3
+#define PACK_NUM_CELLS          15
+#define PACK_CELL_POSITIONS     {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14}
+#else
+#define AFE_NUM_GROUPS          2
+#define PACK_NUM_CELLS          8
+#define PACK_CELL_POSITIONS     {0, 1, 2, 4, 5, 6, 7, 9}
+#endif
+#define AFE_GROUP_POSITIONS     5
+#define AFE_NUM_POSITIONS       (AFE_NUM_GROUPS*AFE_GROUP_POSITIONS)
+#define AFE_NUM_TS              AFE_NUM_GROUPS      //TS1 on the BQ76920, TS1-TS2, TS1-TS3
+//Uncomment to time Update_PackStats() against Get_VCell_Max()+Get_VCell_Min() once at startup,
+//MCLK cycles per call end up in PackStats_BenchCycles[] for the debugger
+//#define PACKSTATS_BENCH
+#define PACKSTATS_BENCH_RUNS    64
+//Uncomment to time every Fault_Update() pass on Timer1_B, MCLK cycles of the last and the longest
+//end up in Fault_BenchCycles[] (interrupts that land in a pass are counted too)
+//#define FAULT_BENCH
+//Uncomment to time 2, 10 and 32 byte AFE reads through I2C_Read() once at startup, timebase ticks
+//and USCI_B0 interrupts per read end up in I2C_BenchTicks[] and I2C_BenchISRs[]
+//#define I2C_BENCH
+#define I2C_BENCH_RUNS          16
+
 //----------------------------------------------------------------------------------------------------
 // Constants
 #define I2C_BQ769xxADDR         0x18
 #define I2C_NTP5312ADDR         0x54
+//Bit rate per device as an SMCLK prescaler (UCB0BRW), AFE at its 100kHz max, NFC tag at 400kHz
+#define I2C_BQ769xxPRESCALE     (SMCLK_FREQ_HZ/100000)
+#define I2C_NTP5312PRESCALE     (SMCLK_FREQ_HZ/400000)
+#define I2C_DFLTPRESCALE        I2C_BQ769xxPRESCALE
+//Bulk NFC transfers are split at this boundary (4 NTAG memory blocks) so they can be preempted,
+//the NTP5312 is addressed by 4 byte block
+#define I2C_NTP5312CHUNK        16
+#define I2C_NTP5312REGSHIFT     2
+//NTP5312 configuration area, read in the background at bulk priority at startup and then every
+//NFC_REFRESH_TICKS Timer0_B ticks (~30.5mS each)
+#define NFC_CFG_BLOCK           0x18
+#define NFC_CFG_BYTES           32
+#define NFC_REFRESH_TICKS       32
+//Reads of at least this many bytes on the wire let the eUSCI byte counter (UCB0TBCNT) generate the
+//STOP, must stay above the 2 register address bytes since the counter sees those as well
+#define I2C_AUTOSTOP_MIN        3
+//Uncomment for BQ769x0 variants with I2C CRC enabled (second hardware revision). Every data byte
+//to and from the AFE is then followed by a CRC-8 (poly 0x07), the NTP5312 is unaffected.
+//#define I2C_BQ769xxCRC
+//Uncomment to record every I2C bus event with a Timer1_B timestamp in a ring buffer of
+//I2C_TRACE_LEN events (power of 2). A short press of the FLT button sends it out the UART.
+//#define I2C_TRACE_ENABLE
+#define I2C_TRACE_LEN           64
 //----------------------------------
 #define SETUP_SYS_CTRL1         0x18    //ADC Enabled
 #define SETUP_SYS_CTRL2         0x43
@@ -52,6 +104,112 @@
 #define MCPC_Thresh             2843    //2.4A
 #define BCPC_Thresh             4739    //4.0A
 
+//Number of back to back I2C transfers that may fail (after retries) before the bus is faulted
+#define BUSF_Thresh             2
+
+//Fault cycles (0.25S) without a trip before an auto-retry fault gets one retry back (10 min)
+#define AUR_DECAY_CYCLES        2400
+
+//----------------------------------
+//Thermistors: 10k B3435 NTC on each TS input, against the AFE's 10k pull-up to 3.3V (the lookup
+//table in BatteryData.c is built for this). What each sensor sits on, parts with a third group
+//have TS3 on the sense resistor, on the others it shares TS2 with the FETs and the PCB. A single
+//group part only has TS1 and every protection reads that.
+#define TS_BATTERY              0
+#if AFE_NUM_TS>1
+#define TS_PCB                  1
+#else
+#define TS_PCB                  0
+#endif
+#define TS_CFET                 TS_PCB
+#define TS_DFET                 TS_PCB
+#if AFE_NUM_TS>2
+#define TS_RSENSE               2
+#else
+#define TS_RSENSE               TS_PCB
+#endif
+
+//Temperature protections in 0.1C, each clears TEMP_HYST_dC back inside its limit
+#define OTPC_Thresh             850     //Charge FET
+#define OTPD_Thresh             850     //Discharge FET
+#define OTPS_Thresh             850     //Sense resistor
+#define UTPP_Thresh             -200    //PCB
+#define OTPP_Thresh             850
+#define UTPB_Thresh             0       //Battery, no charging below 0C
+#define OTPB_Thresh             550
+#define TEMP_HYST_dC            50
+
+//----------------------------------
+//State of charge. Each CC sample is the 250mS average of the sense voltage at 8.44uV/LSB, with the
+//10mOhm sense resistor the current thresholds above assume one mAh is CC_COUNTS_PER_mAh samples.
+#define RSENSE_uOHM             10000
+#define PACK_CAPACITY_mAh       2500
+#define CC_COUNTS_PER_mAh       ((14400UL*RSENSE_uOHM + 4220)/8440)
+#define SOC_REST_COUNTS         24          //|I| under ~20mA is rest
+#define SOC_REST_CYCLES         (30*60*4)   //30 minutes of rest before the OCV is trusted
+#define SOC_SAVE_CYCLES         4           //Charge is written to FRAM once a second
+
+//----------------------------------
+//Coulomb counter offset (auto-zero). Both FETs are opened at startup, and again once the pack has
+//rested CCOFS_REST_CYCLES after CCOFS_PERIOD_CYCLES have passed or when it reaches a temperature
+//bin that has no offset yet. The CC is averaged over CCOFS_SAMPLES samples after
+//CCOFS_SETTLE samples that may still carry current from before the FETs opened.
+#define CCOFS_SETTLE            2
+#define CCOFS_SAMPLES           8           //2 seconds
+#define CCOFS_FILTER_SHIFT      2           //Each new average moves the stored offset by 1/4
+#define CCOFS_REST_CYCLES       (60*4)      //1 minute at rest before the FETs are opened
+#define CCOFS_PERIOD_CYCLES     (6UL*60*60*4)   //Recalibrate every 6 hours
+
+//----------------------------------
+//Cell balancing. A cell is bled once it is BAL_START_mV above the lowest cell and keeps bleeding
+//until it is within BAL_STOP_mV of it, never two cells next to each other in the stack and nothing
+//while the lowest cell is under BAL_MIN_mV. Bleeding runs for BAL_ON_CYCLES alert cycles and then
+//pauses BAL_SETTLE_CYCLES, the last snapshot of the pause reads the cells without bleed current
+//and picks the cells for the next round.
+#define BAL_START_mV            15
+#define BAL_STOP_mV             5
+#define BAL_MIN_mV              3400
+#define BAL_ON_CYCLES           20          //5 seconds
+#define BAL_SETTLE_CYCLES       2
+
+//----------------------------------
+//Cell internal resistance. A load step of at least IR_MIN_STEP CC counts between two steady
+//snapshots (current within IR_STEADY_COUNTS of the one before) no more than IR_MAX_GAP cycles apart
+//gives every cell a dV/dI sample. The filtered value is a Q15 fraction of IR_FULLSCALE_mOHM.
+//State of health runs from 100% at IR_BOL_mOHM down to 0% at IR_EOL_mOHM, and a cell more than
+//IR_WEAK_PERCENT of the pack average is flagged as weak.
+#define IR_FULLSCALE_mOHM       256
+#define IR_MIN_STEP             592         //0.5A
+#define IR_STEADY_COUNTS        24
+#define IR_MAX_GAP              3
+#define IR_BOL_mOHM             30
+#define IR_EOL_mOHM             60
+#define IR_WEAK_PERCENT         150
+
+//----------------------------------
+//Cell history in FRAM: the last HIST_RAW_LEN snapshots (power of 2), HIST_MIN_LEN one minute
+//averages and HIST_HOUR_LEN one hour min/max. About 2.5kB of FRAM for 8S and 4.4kB for 15S.
+#define HIST_RAW_LEN            32          //8 seconds
+#define HIST_MIN_LEN            60          //1 hour
+#define HIST_HOUR_LEN           24          //1 day
+#define HIST_MIN_SAMPLES        240         //Snapshots per minute
+#define HIST_HOUR_MINUTES       60
+
+//Fault event log in FRAM, FLOG_LEN entries (power of 2) of 8 bytes plus FLOG_PRE_LEN (power of 2)
+//pre-trigger cycles of 6 bytes each, 1kB as set. At most FLOG_QUEUE_LEN events are kept per cycle.
+#define FLOG_LEN                32
+#define FLOG_PRE_LEN            4           //1 second
+#define FLOG_QUEUE_LEN          8
+
+//ALERT to FET latency stats (Latency_Handler), in 1uS timebase ticks. LAT_NUM_BINS histogram bins
+//double from LAT_FIRST_BIN_TICKS up, cycles over LAT_BOUND_TICKS are counted in Latency_Over_CT.
+#define LAT_NUM_BINS            8           //Last bin from 32.8mS
+#define LAT_FIRST_BIN_TICKS     512
+#define LAT_BOUND_TICKS         10000       //10mS
+//Uncomment to bring the UART up and dump the fault log and latency stats on a long press of the
+//fault button
+//#define DIAG_UART
+
 
 
 
@@ -102,6 +260,10 @@
 #define REG_ADCGAIN1            0x50
 #define REG_ADCOFFSET           0x51
 #define REG_ADCGAIN2            0x59
+//----------------------------------
+//ADC GAIN is ADC_GAIN_BASE_uV plus the 5 bit trim, ADC_GAIN_NOMINAL_uV is used until it is read
+#define ADC_GAIN_BASE_uV        365
+#define ADC_GAIN_NOMINAL_uV     382
 
 
 #endif
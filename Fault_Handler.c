@@ -14,6 +14,8 @@
 #include <BatteryData.h>
 #include <System.h>
 #include <Constants.h>
+#include <Persistent.h>
+#include <Fault_Log.h>
 #include <stdint.h>
 
 //----------------------------------------------------------------------------------------------------
@@ -29,105 +31,190 @@
 //----------------------------------------------------------------------------------------------------
 
 //----------------------------------------------------------------------------------------------------
-bool FaultHandler_AFE_MCU (FaultPair_AFE_MCU_t *pair,
-                           BiColorLED_t *led,
-                           uint8_t *clearbits,
-                           unsigned int data)
+// Every protection is a row of Fault_Table (Persistent.c) and Fault_Update makes one pass over it.
+// A CLEARED row runs its latch qualifier, a TRIPPED row its clear qualifier, and the outcome is
+// kept as that row's bit in Fault_Tripped. Init_Faults folds the FET column into one mask per FET,
+// so the FET decision is a mask AND each. Adding a protection is adding a row (and its FaultID).
+// A cycle can split the pass in two (FaultPass_t), each row still runs exactly once per cycle and
+// the FETs always come from all of Fault_Tripped.
+//----------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+static uint32_t CHG_Mask = 0;               //Rows that hold the CHG FET open
+static uint32_t DSG_Mask = 0;               //Rows that hold the DSG FET open
+static uint32_t Pass_Mask[FAULT_NUM_PASSES];    //Rows run by each FaultPass_t
+static uint8_t LED_Row = 0;                 //Row after the highest one shown this cycle
+
+#ifdef FAULT_BENCH
+unsigned int Fault_BenchCycles[2];          //MCLK cycles of the last and the longest Fault_Update
+#endif
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static bool Fault_Qualify(FaultQual_t type, QualRef_t qual, signed int value, bool userreset);
+
+//------------------------------------------------------//--------------------------------------------
+void Init_Faults(void)
 {
-    switch(pair->State)
-    {
-    case CLEARED:
-        if(QualHandler_AFE(pair->Latch)==true)
-        {
-            Set_LED_Blinks (led, pair->Fault_Color, pair->Fault_NumBlinks);
-            pair->State=TRIPPED;
-            pair->Trips=(pair->Trips+1);
-            return false;
-        }
-        break;
+    uint32_t Bit = 1;
+    uint8_t CT;
 
-    case TRIPPED:
-        pair->Clear->Value = data;
-        if(QualHandler_MCU(pair->Clear))
-        {
-            *clearbits|=pair->ClearBit;
-            pair->State=CLEARED;
-              return true;
-        }
-        break;
+    CHG_Mask = 0;
+    DSG_Mask = 0;
+    Pass_Mask[FAULT_PASS_FAST] = 0;
+    Pass_Mask[FAULT_PASS_ALL] = 0;
+    for(CT=0; CT<FAULT_NUM; CT++, Bit<<=1)
+    {
+        if(Fault_Table[CT].FETMask & BIT0)
+        {   CHG_Mask |= Bit;    }
+        if(Fault_Table[CT].FETMask & BIT1)
+        {   DSG_Mask |= Bit;    }
+        //A row the AFE latches (OV and UV included) has to be in the fast pass whatever its input,
+        //left to the bulk pass the fast flush would turn its FET back on before the bulk pass trips:
+        if(Fault_Table[CT].LatchType==FAULT_QUAL_AFE || Fault_Table[CT].Input==FAULT_IN_NONE ||
+           Fault_Table[CT].Input==FAULT_IN_CURRENT)
+        {   Pass_Mask[FAULT_PASS_FAST] |= Bit;  }
+        Pass_Mask[FAULT_PASS_ALL] |= Bit;
     }
-
-    return false;
+    Pass_Mask[FAULT_PASS_BULK] = Pass_Mask[FAULT_PASS_ALL] & ~Pass_Mask[FAULT_PASS_FAST];
 }
 
 //----------------------------------------------------------------------------------------------------
-bool FaultHandler_AFE_AUR (FaultPair_AFE_AUR_t *pair,
-                           BiColorLED_t *led,
-                           bool clearflag,
-                           signed int data)
+// One pass over the rows of Fault_Table in pass with inputs[FAULT_NUM_INPUTS] (only the ones those
+// rows use need to be current), returns the FETs the faults allow (BIT1 DSG, BIT0 CHG). A row that
+// trips sets the LED unless a higher row already did this cycle (FAST or ALL starts a cycle), so
+// the highest priority trip is the one shown. SYS_STAT bits of AFE latched rows that cleared are
+// added to clearbits, and every trip and clear is queued for the fault log.
+uint8_t Fault_Update(FaultPass_t pass, const signed int *inputs, bool userreset, BiColorLED_t *led,
+                     uint8_t *clearbits)
 {
-    switch(pair->State)
+    const FaultDesc_t *Row = Fault_Table;
+    uint32_t Tripped = Fault_Tripped;
+    uint32_t Rows = Pass_Mask[pass];
+    uint32_t Bit;
+    uint8_t FETs = BIT1+BIT0;
+    uint8_t Prot = FRAM_Write_Enable();     //Qualifier counters and Fault_* live in FRAM
+#ifdef FAULT_BENCH
+    unsigned int Start = Timebase_Now();
+    unsigned int Cycles;
+#endif
+
+    if(pass!=FAULT_PASS_BULK)
+    {   LED_Row = 0;    }
+
+    for(Bit=1; Row<&Fault_Table[FAULT_NUM]; Row++, Bit<<=1)
     {
-    case CLEARED:
-        if(QualHandler_AFE(pair->Latch)==true)
-        {
-            Set_LED_Blinks (led, pair->Fault_Color, pair->Fault_NumBlinks);
-            pair->State=TRIPPED;
-            pair->Trips=(pair->Trips+1);
-            return false;
-        }
-        break;
-    case TRIPPED:
-        //if(QualHandler_AUR(pair->Clear))
-        if(clearflag)
+        if(!(Rows & Bit))
+        {   continue;   }
+
+        if(!(Tripped & Bit))
         {
-            pair->State=CLEARED;
-              return true;
+            if(Fault_Qualify(Row->LatchType, Row->Latch, inputs[Row->Input], userreset))
+            {   if(Row-Fault_Table>=LED_Row)
+                {   Set_LED_Blinks(led, Row->Color, Row->NumBlinks);
+                    LED_Row = Row-Fault_Table+1;                    }
+                Tripped |= Bit;
+                Fault_Trips[Row-Fault_Table]++;
+                FaultLog_Queue(Row-Fault_Table, FLOG_TRIP, inputs[Row->Input]);     }
+            else if(Row->ClearType==FAULT_QUAL_AUR)
+            {   QualDecay_AUR(Row->Clear.AUR, userreset);                           }
         }
-        break;
+        else if(Row->LatchType==FAULT_QUAL_AFE && QualHandler_AFE(Row->Latch.AFE))
+        {   continue;   }       //Still reported by the AFE in this SYS_STAT, no clearing yet
+        else if(Fault_Qualify(Row->ClearType, Row->Clear, inputs[Row->Input], userreset))
+        {   *clearbits |= Row->ClearBit;
+            Tripped &= ~Bit;
+            FaultLog_Queue(Row-Fault_Table, FLOG_CLEAR, inputs[Row->Input]);        }
     }
+    Fault_Tripped = Tripped;
 
-    return false;
+    if(Tripped & CHG_Mask)
+    {   FETs &= ~BIT0;  }
+    if(Tripped & DSG_Mask)
+    {   FETs &= ~BIT1;  }
+
+#ifdef FAULT_BENCH
+    Cycles = (uint16_t)(Timebase_Now() - Start) * TIMEBASE_CYCLES_PER_TICK;
+    Fault_BenchCycles[0] = Cycles;
+    if(Cycles>Fault_BenchCycles[1])
+    {   Fault_BenchCycles[1] = Cycles;  }
+#endif
+
+    FRAM_Write_Restore(Prot);
+    return FETs;
 }
 
+//----------------------------------------------------------------------------------------------------
+FaultState_t Fault_Get_State(uint8_t fault)
+{   return (Fault_Tripped & ((uint32_t)1<<fault)) ? TRIPPED : CLEARED;   }
 
 //----------------------------------------------------------------------------------------------------
-bool FaultHandler_MCU_AUR (FaultPair_MCU_AUR_t *pair,
-                           BiColorLED_t *led,
-                           bool clearflag,
-                           signed int data)
+// Run the qualifier of one side of a row, MCU thresholds take their input first
+static bool Fault_Qualify(FaultQual_t type, QualRef_t qual, signed int value, bool userreset)
 {
-    switch(pair->State)
+    switch(type)
     {
-    case CLEARED:
-        pair->Latch->Value = data;
-        if(QualHandler_MCU(pair->Latch))
-        {
-            Set_LED_Blinks (led, pair->Fault_Color, pair->Fault_NumBlinks);
-            pair->State=TRIPPED;
-            pair->Trips=(pair->Trips+1);
-            return false;
-        }
-        break;
-    case TRIPPED:
-        //if(QualHandler_AUR(pair->Clear))
-        if(clearflag)
-        {
-            pair->State=CLEARED;
-              return true;
-        }
-        break;
+    case FAULT_QUAL_AFE:
+        return QualHandler_AFE(qual.AFE);
+
+    case FAULT_QUAL_MCU:
+        qual.MCU->Value = value;
+        return QualHandler_MCU(qual.MCU);
+
+    case FAULT_QUAL_AUR:
+        return QualHandler_AUR(qual.AUR, userreset);
     }
 
     return false;
 }
 
+//----------------------------------------------------------------------------------------------------
+// AUR Qualifier Handler, runs every cycle the fault is TRIPPED. The fault reset button always
+// clears and gives back the whole retry budget. Otherwise, with AutoRetry, the fault clears after
+// AutoInterval_LIM cycles as long as retries are left, and once Retry_LIM of them have been used
+// without a quiet period in between it waits for the button (NeedUserReset).
+bool QualHandler_AUR (Qual_AUR_t *qual, bool userreset)
+{
+    qual->Quiet_CT=0;
+
+    if(userreset)
+    {   qual->AutoInterval_CT=0;
+        qual->Retry_CT=0;
+        qual->NeedUserReset=false;
+        return true;                }
+
+    if(!qual->AutoRetry || qual->NeedUserReset)
+    {   return false;   }
+
+    if(qual->Retry_CT>=qual->Retry_LIM)
+    {   qual->NeedUserReset=true;
+        return false;               }
+
+    qual->AutoInterval_CT++;
+    if(qual->AutoInterval_CT<qual->AutoInterval_LIM)
+    {   return false;   }
+
+    qual->AutoInterval_CT=0;
+    qual->Retry_CT++;
+    return true;
+}
 
 //----------------------------------------------------------------------------------------------------
-// AUR Qualifier Handler
-bool QualHandler_AUR (Qual_AUR_t *qual)
+// AUR retry budget decay, runs every cycle the fault is CLEARED
+void QualDecay_AUR (Qual_AUR_t *qual, bool userreset)
 {
-    return false;
+    if(userreset)
+    {   qual->Retry_CT=0;   }
+
+    if(qual->Retry_CT==0)
+    {   qual->Quiet_CT=0;
+        return;             }
+
+    qual->Quiet_CT++;
+    if(qual->Quiet_CT>=AUR_DECAY_CYCLES)
+    {   qual->Quiet_CT=0;
+        qual->Retry_CT--;   }
 }
 
 //----------------------------------------------------------------------------------------------------
@@ -15,7 +15,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <System.h>
-
+#include "Constants.h"
 
 //----------------------------------------------------------------------------------------------------
 // Enumerations
@@ -56,7 +56,8 @@ typedef struct
 bool QualHandler_MCU (Qual_MCU_t *qual);
 
 //----------------------------------------------------------------------------------------------------
-// Auto-Retry/User-Reset Qualifier Type
+// Auto-Retry/User-Reset Qualifier Type. Intervals are counted in fault cycles (0.25S), Retry_CT is
+// the retries used up, one of them is given back after every AUR_DECAY_CYCLES without a trip.
 typedef struct
 {
     bool AutoRetry;
@@ -65,89 +66,77 @@ typedef struct
     uint8_t Retry_CT;
     uint8_t Retry_LIM;
     bool NeedUserReset;
+    uint16_t Quiet_CT;
 } Qual_AUR_t;
 
-bool QualHandler_AUR (Qual_AUR_t *qual);
+bool QualHandler_AUR (Qual_AUR_t *qual, bool userreset);
+void QualDecay_AUR (Qual_AUR_t *qual, bool userreset);
 
 //----------------------------------------------------------------------------------------------------
-// Main fault pair for referencing Latch/Clear structs
-typedef struct
-{
-    FaultState_t State;
-    Qual_AFE_t *Latch;
-    Qual_MCU_t *Clear;
-    unsigned int Trips;
-    const uint8_t ClearBit;
-
-    unsigned int Fault_CT;
-    unsigned int Fault_NumBlinks;
-    BiColor_t Fault_Color;
+// Fault table types. Each row of Fault_Table is one protection: what latches it, what clears it,
+// which FETs it holds open while tripped and how it shows on the fault LED. The row index is both
+// its priority and its bit in Fault_Tripped, rows go from lowest to highest LED priority.
 
-} FaultPair_AFE_MCU_t;
-
-bool FaultHandler_AFE_MCU (FaultPair_AFE_MCU_t *pair,
-                           BiColorLED_t *led,
-                           uint8_t *clearbits,
-                           unsigned int data);
-
-//----------------------------------------------------------------------------------------------------
-// Main fault pair for referencing Latch/Clear structs
-typedef struct
+typedef enum
 {
-    FaultState_t State;
-    Qual_AFE_t *Latch;
-    Qual_AUR_t *Clear;
-    unsigned int Trips;
-    uint8_t ClearBit;
-
-    unsigned int Fault_CT;
-    unsigned int Fault_NumBlinks;
-    BiColor_t Fault_Color;
+    FAULT_QUAL_AFE,             //Latch only, a SYS_STAT bit set by the AFE
+    FAULT_QUAL_MCU,             //Latch or clear, a threshold on one of the fault inputs
+    FAULT_QUAL_AUR              //Clear only, auto-retry or the fault reset button
+} FaultQual_t;
 
-} FaultPair_AFE_AUR_t;
-
-bool FaultHandler_AFE_AUR (FaultPair_AFE_AUR_t *pair,
-                           BiColorLED_t *led,
-                           bool clearflag,
-                           signed int data);
-
-//----------------------------------------------------------------------------------------------------
-// Main fault pair for referencing Latch/Clear structs
-typedef struct
+//Data the MCU thresholds compare against, gathered once per cycle by the caller:
+typedef enum
 {
-    FaultState_t State;
-    Qual_MCU_t *Latch;
-    Qual_MCU_t *Clear;
-    unsigned int Trips;
-
-    unsigned int Fault_CT;
-    unsigned int Fault_NumBlinks;
-    BiColor_t Fault_Color;
-
-} FaultPair_MCU_MCU_t;
+    FAULT_IN_NONE,              //Rows without an MCU qualifier
+    FAULT_IN_CURRENT,           //CC counts, offset removed, charge positive
+    FAULT_IN_VCELL_MIN,         //mV
+    FAULT_IN_VCELL_MAX,         //mV
+    FAULT_IN_BUSFAIL,           //Failed I2C transfers in a row
+    FAULT_IN_TS,                //0.1C, FAULT_IN_TS+n is TS n
+    FAULT_NUM_INPUTS = FAULT_IN_TS+AFE_NUM_TS
+} FaultInput_t;
+
+//Rows a Fault_Update pass runs. FAST is every row that needs only SYS_STAT and the current (input
+//NONE or CURRENT), so it can run before the cells and TS are read, and every AFE latched row. Those
+//trip on their SYS_STAT bit, their clear qualifier works from the last cycle's input. BULK is the
+//rest:
+typedef enum
+{
+    FAULT_PASS_FAST,
+    FAULT_PASS_BULK,
+    FAULT_PASS_ALL,
+    FAULT_NUM_PASSES
+} FaultPass_t;
 
-bool FaultHandler_MCU_MCU (FaultPair_MCU_MCU_t *pair,
-                           BiColorLED_t *led,
-                           unsigned int data);
+typedef union
+{
+    Qual_AFE_t *AFE;
+    Qual_MCU_t *MCU;
+    Qual_AUR_t *AUR;
+} QualRef_t;
 
-//----------------------------------------------------------------------------------------------------
-// Main fault pair for referencing Latch/Clear structs
 typedef struct
 {
-    FaultState_t State;
-    Qual_MCU_t *Latch;
-    Qual_AUR_t *Clear;
-    unsigned int Trips;
-
-    unsigned int Fault_CT;
-    unsigned int Fault_NumBlinks;
-    BiColor_t Fault_Color;
+    FaultQual_t LatchType;
+    QualRef_t Latch;
+    FaultQual_t ClearType;
+    QualRef_t Clear;
+    FaultInput_t Input;
+    uint8_t FETMask;            //FETs held open while tripped, BIT0 CHG, BIT1 DSG
+    uint8_t ClearBit;           //SYS_STAT bit to write 1 to once cleared, 0 for none
+    uint8_t NumBlinks;
+    BiColor_t Color;
+} FaultDesc_t;
 
-} FaultPair_MCU_AUR_t;
-
-bool FaultHandler_MCU_AUR (FaultPair_MCU_AUR_t *pair,
-                           BiColorLED_t *led,
-                           bool clearflag,
-                           signed int data);
+//----------------------------------------------------------------------------------------------------
+// Fault engine
+void Init_Faults(void);
+uint8_t Fault_Update(FaultPass_t pass, const signed int *inputs, bool userreset, BiColorLED_t *led,
+                     uint8_t *clearbits);
+FaultState_t Fault_Get_State(uint8_t fault);
+
+#ifdef FAULT_BENCH
+extern unsigned int Fault_BenchCycles[2];
+#endif
 
 #endif
@@ -0,0 +1,127 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Fault_Log.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Fault trip and clear events in an FRAM ring, each with a timestamp and the pack state leading
+ * up to it, dumped over the UART for HostSim/FaultLog_Decode
+----------------------------------------------------------------------------------------------------*/
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+#include "System.h"
+#include "UART_Interface.h"
+#include "Fault_Log.h"
+
+//----------------------------------------------------------------------------------------------------
+// Fault_Update only queues events in RAM while it runs, FaultLog_Update writes them to FRAM once
+// the FETs for the cycle have been flushed, so logging never sits between a trip and the FET
+// write. At most FLOG_QUEUE_LEN entries go out per cycle, each a fixed size copy, the rest are
+// counted in Dropped. The pre-trigger ring is kept in RAM and copied into every entry. An entry is
+// complete before Head moves past it, so a reset during the write only loses that entry.
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+#pragma PERSISTENT(FaultLog_Store);
+FaultLogStore_t FaultLog_Store = {0};
+
+static FaultLogPre_t Pre[FLOG_PRE_LEN];     //Pre-trigger ring, Pre[Pre_Idx] is the oldest
+static uint8_t Pre_Idx = 0;
+
+static struct
+{
+    uint8_t Fault;
+    uint8_t Event;
+    int16_t Value;
+} Queue[FLOG_QUEUE_LEN];
+static uint8_t Queue_CT = 0;
+static uint8_t Lost_CT = 0;
+
+//------------------------------------------------------//--------------------------------------------
+// Called from Fault_Update for every trip and clear, RAM only
+void FaultLog_Queue(uint8_t fault, FaultLogEvt_t event, signed int value)
+{
+    if(Queue_CT>=FLOG_QUEUE_LEN)
+    {   Lost_CT++;
+        return;     }
+
+    Queue[Queue_CT].Fault = fault;
+    Queue[Queue_CT].Event = event;
+    Queue[Queue_CT].Value = value;
+    Queue_CT++;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Called once per fault cycle after the FETs are flushed, with the same cell extremes and current
+// the faults were checked against
+void FaultLog_Update(unsigned int vmin, unsigned int vmax, signed int cc)
+{
+    FaultLogStore_t *L = &FaultLog_Store;
+    FaultLogEntry_t *E;
+    uint8_t Prot;
+    uint8_t CT;
+    uint8_t Idx;
+
+    Pre[Pre_Idx].Min_mV = vmin;
+    Pre[Pre_Idx].Max_mV = vmax;
+    Pre[Pre_Idx].CC = cc;
+    Pre_Idx = (Pre_Idx+1) & (FLOG_PRE_LEN-1);
+
+    Prot = FRAM_Write_Enable();
+    L->Tick++;
+
+    for(CT=0; CT<Queue_CT; CT++)
+    {
+        E = &L->Entry[L->Head];
+        E->Tick = L->Tick;
+        E->Fault = Queue[CT].Fault;
+        E->Event = Queue[CT].Event;
+        E->Value = Queue[CT].Value;
+        for(Idx=0; Idx<FLOG_PRE_LEN; Idx++)
+        {   E->Pre[Idx] = Pre[(Pre_Idx+Idx) & (FLOG_PRE_LEN-1)];     }
+
+        L->Head = (L->Head+1) & (FLOG_LEN-1);
+        if(L->Count<0xFFFF)
+        {   L->Count++;     }
+    }
+    if(Lost_CT)
+    {   L->Dropped = (L->Dropped>0xFFFF-Lost_CT) ? 0xFFFF : L->Dropped+Lost_CT;     }
+
+    FRAM_Write_Restore(Prot);
+    Queue_CT = 0;
+    Lost_CT = 0;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Send the log out the UART oldest entry first and leave it in place. Ticks go out as two 16 bit
+// halves since the UART printf has no portable 32 bit format. Lines are
+//   FLOG BEGIN <entries> <dropped> <tick hi> <tick lo>
+//   FLOG <tick hi> <tick lo> <fault> <event> <value> then <min mV> <max mV> <cc> per Pre[]
+//   FLOG END
+void FaultLog_Dump(void)
+{
+    FaultLogStore_t *L = &FaultLog_Store;
+    FaultLogEntry_t *E;
+    unsigned int Num = (L->Count<FLOG_LEN) ? L->Count : FLOG_LEN;
+    unsigned int Idx = (L->Head - Num) & (FLOG_LEN-1);
+    unsigned int CT;
+    uint8_t Pre_CT;
+
+    printf("FLOG BEGIN %u %u %u %u\n", Num, L->Dropped, (uint16_t)(L->Tick>>16),
+           (uint16_t)L->Tick);
+    for(CT=0; CT<Num; CT++)
+    {
+        E = &L->Entry[Idx];
+        printf("FLOG %u %u %u %u %i", (uint16_t)(E->Tick>>16), (uint16_t)E->Tick, E->Fault,
+               E->Event, E->Value);
+        for(Pre_CT=0; Pre_CT<FLOG_PRE_LEN; Pre_CT++)
+        {   printf(" %u %u %i", E->Pre[Pre_CT].Min_mV, E->Pre[Pre_CT].Max_mV, E->Pre[Pre_CT].CC);  }
+        printf("\n");
+        Idx = (Idx+1) & (FLOG_LEN-1);
+    }
+    printf("FLOG END\n");
+}
@@ -0,0 +1,75 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Fault_Log.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Fault trip and clear events in an FRAM ring, each with a timestamp and the pack state leading
+ * up to it, dumped over the UART for HostSim/FaultLog_Decode
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef FAULT_LOG_H
+#define FAULT_LOG_H
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+
+//----------------------------------------------------------------------------------------------------
+// Enumerations
+typedef enum
+{
+    FLOG_CLEAR,
+    FLOG_TRIP
+} FaultLogEvt_t;
+
+//----------------------------------------------------------------------------------------------------
+// Structs
+
+//----------------------------------------------------------------------------------------------------
+// One fault cycle of pre-trigger data, CC is the 250mS sample with the offset removed
+typedef struct
+{
+    uint16_t Min_mV;
+    uint16_t Max_mV;
+    int16_t CC;
+} FaultLogPre_t;
+
+//----------------------------------------------------------------------------------------------------
+// Tick counts fault cycles (0.25S) since the first boot. Value is the input the row's qualifiers
+// compare against (0 for rows without one). Pre[] is oldest first, the last one is the cycle of the
+// event itself.
+typedef struct
+{
+    uint32_t Tick;
+    uint8_t Fault;                      //FaultID_t
+    uint8_t Event;                      //FaultLogEvt_t
+    int16_t Value;
+    FaultLogPre_t Pre[FLOG_PRE_LEN];
+} FaultLogEntry_t;
+
+//----------------------------------------------------------------------------------------------------
+// Entry[Head] is written next, Count is the number of entries ever written (saturating) so the last
+// min(Count, FLOG_LEN) are valid. Dropped counts events that did not fit in a cycle's queue.
+typedef struct
+{
+    FaultLogEntry_t Entry[FLOG_LEN];
+    uint32_t Tick;
+    uint16_t Head;
+    uint16_t Count;
+    uint16_t Dropped;
+} FaultLogStore_t;
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void FaultLog_Queue(uint8_t fault, FaultLogEvt_t event, signed int value);
+void FaultLog_Update(unsigned int vmin, unsigned int vmax, signed int cc);
+void FaultLog_Dump(void);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern FaultLogStore_t FaultLog_Store;
+
+#endif
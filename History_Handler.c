@@ -0,0 +1,78 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: History_Handler.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Cell voltage and current history in FRAM at three resolutions, for post-mortem readout
+----------------------------------------------------------------------------------------------------*/
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+#include "System.h"
+#include "BatteryData.h"
+#include "History_Handler.h"
+
+//----------------------------------------------------------------------------------------------------
+// Each snapshot goes into the next raw slot, is added to the minute sums and widens the current
+// hour's min/max, all in the same pass over the cells. Nothing is ever moved between tiers: once
+// HIST_MIN_SAMPLES are summed their averages are written to the next minute slot and the sums start
+// over, and every HIST_HOUR_MINUTES minutes the next hour slot is started from the next snapshot.
+// The zeroed FRAM image of the first boot is a valid empty history.
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+#pragma PERSISTENT(History_Store);
+HistStore_t History_Store = {0};
+
+//------------------------------------------------------//--------------------------------------------
+// Called once per alert cycle with CC_READY set, after the snapshot, cc with the offset removed
+void History_Update(signed int cc)
+{
+    HistStore_t *H = &History_Store;
+    HistSample_t *Raw = &H->Raw[H->Raw_Idx];
+    HistMinMax_t *Hour = &H->Hour[H->Hour_Idx];
+    HistSample_t *Minute;
+    bool NewHour = (H->Min_CT==0 && H->Hour_CT==0);
+    uint8_t Prot = FRAM_Write_Enable();
+    unsigned int mV;
+    uint8_t CT;
+
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {
+        mV = Get_VCell_mV(CT);
+        Raw->Cell_mV[CT] = mV;
+        H->MinSum_mV[CT] += mV;
+        if(NewHour || mV<Hour->Min_mV[CT])
+        {   Hour->Min_mV[CT] = mV;  }
+        if(NewHour || mV>Hour->Max_mV[CT])
+        {   Hour->Max_mV[CT] = mV;  }
+    }
+    Raw->CC = cc;
+    H->MinSum_CC += cc;
+    H->Raw_Idx = (H->Raw_Idx+1) & (HIST_RAW_LEN-1);
+    H->Cycles++;
+
+    H->Min_CT++;
+    if(H->Min_CT>=HIST_MIN_SAMPLES)
+    {
+        Minute = &H->Minute[H->Min_Idx];
+        for(CT=0; CT<PACK_NUM_CELLS; CT++)
+        {   Minute->Cell_mV[CT] = H->MinSum_mV[CT] / HIST_MIN_SAMPLES;
+            H->MinSum_mV[CT] = 0;                                       }
+        Minute->CC = H->MinSum_CC / HIST_MIN_SAMPLES;
+        H->MinSum_CC = 0;
+        H->Min_CT = 0;
+        H->Min_Idx = (H->Min_Idx<HIST_MIN_LEN-1) ? H->Min_Idx+1 : 0;
+
+        H->Hour_CT++;
+        if(H->Hour_CT>=HIST_HOUR_MINUTES)
+        {   H->Hour_CT = 0;
+            H->Hour_Idx = (H->Hour_Idx<HIST_HOUR_LEN-1) ? H->Hour_Idx+1 : 0;    }
+    }
+
+    FRAM_Write_Restore(Prot);
+}
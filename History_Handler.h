@@ -0,0 +1,67 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: History_Handler.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Cell voltage and current history in FRAM at three resolutions, for post-mortem readout
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef HISTORY_HANDLER_H
+#define HISTORY_HANDLER_H
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+
+//----------------------------------------------------------------------------------------------------
+// Structs
+
+//----------------------------------------------------------------------------------------------------
+// One snapshot, or the average of a minute of them. CC is the 250mS CC sample, offset removed.
+typedef struct
+{
+    uint16_t Cell_mV[PACK_NUM_CELLS];
+    int16_t CC;
+} HistSample_t;
+
+//----------------------------------------------------------------------------------------------------
+// Lowest and highest reading of each cell over an hour
+typedef struct
+{
+    uint16_t Min_mV[PACK_NUM_CELLS];
+    uint16_t Max_mV[PACK_NUM_CELLS];
+} HistMinMax_t;
+
+//----------------------------------------------------------------------------------------------------
+// Everything lives in FRAM, including the minute being summed and the hour being tracked, so a
+// reset only loses the snapshot it interrupted. Each *_Idx is the slot written next (Raw, Minute)
+// or being filled (Hour), Cycles counts every snapshot since the first boot and dates the rest:
+// Raw[Raw_Idx-1] is snapshot Cycles-1, Minute[Min_Idx-1] ended Min_CT snapshots ago, and so on.
+// A readout of History_Store from the debugger or BSL holds the whole record.
+typedef struct
+{
+    HistSample_t Raw[HIST_RAW_LEN];
+    HistSample_t Minute[HIST_MIN_LEN];
+    HistMinMax_t Hour[HIST_HOUR_LEN];
+    uint32_t MinSum_mV[PACK_NUM_CELLS];
+    int32_t MinSum_CC;
+    uint32_t Cycles;
+    uint16_t Raw_Idx;
+    uint16_t Min_Idx;
+    uint16_t Min_CT;
+    uint16_t Hour_Idx;
+    uint16_t Hour_CT;
+} HistStore_t;
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void History_Update(signed int cc);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern HistStore_t History_Store;
+
+#endif
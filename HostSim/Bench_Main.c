@@ -0,0 +1,189 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Bench_Main.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Host instruction counts of single firmware calls, for comparing two versions of a hot path when
+ * no board is at hand. The simulator runs firmware code in zero simulated time, so the Timer1_B
+ * benches (PACKSTATS_BENCH, FAULT_BENCH) read 0 on the host. Here the call runs in a forked child
+ * that the parent single steps with ptrace, which gives an exact and repeatable count of host
+ * instructions. These are x86 numbers: they rank two versions of the same code, they are not MSP430
+ * cycles, the on-target benches are still the ones to quote for the board.
+----------------------------------------------------------------------------------------------------*/
+#ifdef BMS_HOST_SIM
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include "msp430.h"
+#include "Constants.h"
+#include "BatteryData.h"
+#include "Fault_Handler.h"
+
+//----------------------------------------------------------------------------------------------------
+// Usage: bms_bench
+//   Prints one line per benched call: name, host instructions, instructions less the empty call
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+extern unsigned int CellADCVals[PACK_NUM_CELLS];
+extern signed int TempVals_dC[AFE_NUM_TS];
+extern unsigned char StatReg;
+extern unsigned int Cell_VMax;
+extern unsigned int Cell_VMin;
+extern signed int IMeasured;
+extern uint8_t FETBits;
+static volatile unsigned int Sink;
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static long Bench_Count(void (*call)(void));
+static void Bench_Print(const char *name, void (*call)(void));
+static void Bench_Empty(void);
+static void Bench_Extremes(void);
+static void Bench_PackStats(void);
+static void Bench_FaultCycle(void);
+static uint8_t Bench_CyclesToTrip(void);
+
+void Fault_Handler(FaultPass_t pass);
+
+static long EmptyCount;
+
+//------------------------------------------------------//--------------------------------------------
+int main(void)
+{
+    uint8_t CT;
+
+    // Spread the cells over 3.2V-3.9V out of order, so min and max are neither first nor last
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {   CellADCVals[CT] = 8400 + ((CT*7)%PACK_NUM_CELLS)*120;   }
+
+    EmptyCount = Bench_Count(Bench_Empty);
+    printf("Host instructions, %u cells, empty call %ld\n", PACK_NUM_CELLS, EmptyCount);
+    Bench_Print("Get_VCell_Max()+Get_VCell_Min()", Bench_Extremes);
+    Bench_Print("Update_PackStats()", Bench_PackStats);
+
+    // A fault cycle is the fast pass and the bulk pass of one ALERT. Idle has every input nominal.
+    // An AFE trip has SYS_STAT report an overcurrent, which opens DSG in the same cycle. An MCU trip
+    // has a discharge current over MCPD_Thresh, the benched cycle is the one its qualifier trips in.
+    Init_Faults();
+    Update_PackStats();
+    Cell_VMax = PackStats.Max_mV;
+    Cell_VMin = PackStats.Min_mV;
+    IMeasured = 0;
+    for(CT=0; CT<AFE_NUM_TS; CT++)
+    {   TempVals_dC[CT] = 250;  }
+    StatReg = 0;
+    Bench_FaultCycle();
+    Bench_Print("Fault cycle, idle", Bench_FaultCycle);
+    StatReg = BIT0;
+    Bench_Print("Fault cycle, AFE trip (OCD)", Bench_FaultCycle);
+    StatReg = 0;
+    IMeasured = 2*MCPD_Thresh;
+    for(CT=Bench_CyclesToTrip(); CT>1; CT--)
+    {   Bench_FaultCycle();     }
+    Bench_Print("Fault cycle, MCU trip (MCPD)", Bench_FaultCycle);
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Runs call in a forked child between two SIGSTOPs and single steps it, the state the parent set up
+// is what the child starts from, and nothing the call changes comes back
+static long Bench_Count(void (*call)(void))
+{
+    pid_t Child;
+    int Status;
+    long Steps = 0;
+
+    fflush(stdout);
+    Child = fork();
+    if(Child<0)
+    {   perror("fork");
+        exit(1);        }
+    if(Child==0)
+    {   ptrace(PTRACE_TRACEME, 0, 0, 0);
+        raise(SIGSTOP);
+        call();
+        raise(SIGSTOP);
+        _exit(0);                           }
+
+    waitpid(Child, &Status, 0);
+    while(1)
+    {
+        if(ptrace(PTRACE_SINGLESTEP, Child, 0, 0)<0)
+        {   perror("ptrace");
+            exit(1);            }
+        waitpid(Child, &Status, 0);
+        if(WIFEXITED(Status) || (WIFSTOPPED(Status) && WSTOPSIG(Status)==SIGSTOP))
+        {   break;  }
+        Steps++;
+    }
+    kill(Child, SIGKILL);
+    waitpid(Child, &Status, 0);
+    return Steps;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Number of fault cycles from the current state until one opens a FET, run in a child that is
+// thrown away, 0 if none within 255
+static uint8_t Bench_CyclesToTrip(void)
+{
+    pid_t Child;
+    int Status;
+    uint8_t CT;
+
+    fflush(stdout);
+    Child = fork();
+    if(Child<0)
+    {   perror("fork");
+        exit(1);        }
+    if(Child==0)
+    {   for(CT=1; CT<255; CT++)
+        {   Bench_FaultCycle();
+            if(FETBits!=(BIT1+BIT0))
+            {   _exit(CT);  }   }
+        _exit(0);                           }
+
+    waitpid(Child, &Status, 0);
+    return WIFEXITED(Status) ? WEXITSTATUS(Status) : 0;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Bench_Print(const char *name, void (*call)(void))
+{
+    long Steps = Bench_Count(call);
+
+    printf("  %-36s %6ld %6ld\n", name, Steps, Steps-EmptyCount);
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Bench_Empty(void)
+{
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Bench_Extremes(void)
+{
+    Sink = Get_VCell_Max();
+    Sink = Get_VCell_Min();
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Bench_PackStats(void)
+{
+    Update_PackStats();
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Bench_FaultCycle(void)
+{
+    Fault_Handler(FAULT_PASS_FAST);
+    Fault_Handler(FAULT_PASS_BULK);
+}
+
+#endif
@@ -0,0 +1,164 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: FaultLog_Decode.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Host tool that reads fault log and latency dumps (FaultLog_Dump() and Latency_Report() output
+ * captured from the UART or from bms_sim -L) on stdin and prints the events with their pre-trigger
+ * data, a per fault summary and the latency tables
+----------------------------------------------------------------------------------------------------*/
+#ifdef BMS_HOST_SIM
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------------------------------
+// Ticks are fault cycles, one per 250mS CC conversion. Times are printed from the first boot and as
+// an age before the dump. Anything else on the input is ignored, so a raw UART log can be fed in as
+// is. With several dumps in the input the events of each are listed and all go into the summary.
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define TICK_S                  0.25
+#define CC_mA_PER_COUNT         (8.44/10.0)         //8.44uV CC LSB over RSENSE_uOHM 10000
+#define MAX_PRE                 16
+#define NUM_FAULTS              16
+#define MAX_BINS                16
+#define NUM_STAGES              4
+
+//Must match FaultID_t in Persistent.h
+static const char *FaultName[NUM_FAULTS] = {"MCPC", "BCPC", "MCPD", "BCPD", "OTPC", "OTPD", "OTPS",
+                                            "UTPP", "OTPP", "UTPB", "OTPB", "OCPD", "SCPD", "UVP",
+                                            "OVP", "BUSF"};
+
+//Unit of the value logged with each fault, from the input its row compares against
+static const char *FaultUnit[NUM_FAULTS] = {"CC", "CC", "CC", "CC", "0.1C", "0.1C", "0.1C", "0.1C",
+                                            "0.1C", "0.1C", "0.1C", "", "", "mV", "mV", "fails"};
+
+//Must match LatStage_t in Latency_Handler.h
+static const char *StageName[NUM_STAGES] = {"ALERT-STAT", "STAT-DECIDE", "DECIDE-FET", "ALERT-FET"};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+static unsigned long Trip_CT[NUM_FAULTS];
+static unsigned long Clear_CT[NUM_FAULTS];
+
+//----------------------------------------------------------------------------------------------------
+static const char *Name_Of(unsigned int fault)
+{   return (fault<NUM_FAULTS) ? FaultName[fault] : "?";     }
+
+//----------------------------------------------------------------------------------------------------
+// One "FLOG <tick hi> <tick lo> <fault> <event> <value> <min> <max> <cc>..." entry
+static bool Decode_Entry(const char *line, unsigned long now)
+{
+    unsigned int Hi, Lo, Fault, Event;
+    unsigned int Min[MAX_PRE], Max[MAX_PRE];
+    int Value;
+    int CC[MAX_PRE];
+    unsigned long Tick;
+    unsigned int Num = 0;
+    unsigned int CT;
+    int Used;
+
+    if(sscanf(line, " FLOG %u %u %u %u %d%n", &Hi, &Lo, &Fault, &Event, &Value, &Used)!=5)
+    {   return false;   }
+    line += Used;
+    while(Num<MAX_PRE && sscanf(line, " %u %u %d%n", &Min[Num], &Max[Num], &CC[Num], &Used)==3)
+    {   line += Used;
+        Num++;          }
+
+    Tick = ((unsigned long)Hi<<16) | Lo;
+    if(Fault<NUM_FAULTS)
+    {   if(Event)
+        {   Trip_CT[Fault]++;   }
+        else
+        {   Clear_CT[Fault]++;  }       }
+
+    printf("%10.2f s  %8.2f s ago  %-4s %-5s", Tick*TICK_S, (now>=Tick ? now-Tick : 0)*TICK_S,
+           Name_Of(Fault), Event ? "TRIP" : "CLEAR");
+    if(Fault<NUM_FAULTS && FaultUnit[Fault][0])
+    {   printf("  %6d %-5s", Value, FaultUnit[Fault]);    }
+    else
+    {   printf("  %12s", "");   }
+    printf("  pre:");
+    for(CT=0; CT<Num; CT++)
+    {   printf(" %u-%umV %.0fmA", Min[CT], Max[CT], CC[CT]*CC_mA_PER_COUNT);
+        if(CT<Num-1)
+        {   printf(" |");   }                                                   }
+    printf("\n");
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------
+// One "LAT <S|F> <id> <num> <min> <max> <avg> <hist...>" line of a latency report, times in uS
+static bool Decode_Latency(const char *line, unsigned int bin0)
+{
+    char Type;
+    unsigned int Id, Num, Min, Max, Avg;
+    unsigned int Hist[MAX_BINS];
+    unsigned int Bins = 0;
+    unsigned int CT;
+    int Used;
+
+    if(sscanf(line, " LAT %c %u %u %u %u %u%n", &Type, &Id, &Num, &Min, &Max, &Avg, &Used)!=6)
+    {   return false;   }
+    line += Used;
+    while(Bins<MAX_BINS && sscanf(line, " %u%n", &Hist[Bins], &Used)==1)
+    {   line += Used;
+        Bins++;         }
+
+    if(Type=='S')
+    {   printf("  %-12s", Id<NUM_STAGES ? StageName[Id] : "?");     }
+    else
+    {   printf("  %-12s", Name_Of(Id));     }
+    printf("%6u  %6u %6u %6u us ", Num, Min, Max, Avg);
+    for(CT=0; CT<Bins; CT++)
+    {   if(Hist[CT] && CT<Bins-1)
+        {   printf(" <%u:%u", bin0<<CT, Hist[CT]);     }
+        else if(Hist[CT])
+        {   printf(" >=%u:%u", bin0<<(CT-1), Hist[CT]);    }   }
+    printf("\n");
+    return true;
+}
+
+//------------------------------------------------------//--------------------------------------------
+int main(void)
+{
+    char Line[512];
+    unsigned int Num, Dropped, Hi, Lo;
+    unsigned int Over, Missed, Bound, Bin0 = 512;
+    unsigned long Now = 0;
+    unsigned long Dumps = 0;
+    unsigned int CT;
+
+    while(fgets(Line, sizeof(Line), stdin))
+    {
+        if(sscanf(Line, " FLOG BEGIN %u %u %u %u", &Num, &Dropped, &Hi, &Lo)==4)
+        {   Now = ((unsigned long)Hi<<16) | Lo;
+            Dumps++;
+            printf("dump at %.2f s: %u events, %u dropped\n", Now*TICK_S, Num, Dropped);
+            continue;                                                                       }
+        if(sscanf(Line, " LAT BEGIN %u %u %u %u", &Over, &Missed, &Bound, &Bin0)==4)
+        {   printf("latency: %u cycles over %u us, %u not timed\n", Over, Bound, Missed);
+            printf("  %-12s%6s  %6s %6s %6s     histogram us:cycles\n", "", "num", "min", "max",
+                   "avg");
+            continue;                                                                       }
+        if(!strncmp(Line, "FLOG END", 8) || !strncmp(Line, "LAT END", 7))
+        {   continue;   }
+        if(Decode_Latency(Line, Bin0))
+        {   continue;   }
+        Decode_Entry(Line, Now);
+    }
+
+    printf("\n%lu dumps\n", Dumps);
+    for(CT=0; CT<NUM_FAULTS; CT++)
+    {   if(Trip_CT[CT] || Clear_CT[CT])
+        {   printf("%-4s  %lu trips, %lu clears\n", FaultName[CT], Trip_CT[CT], Clear_CT[CT]);    }   }
+    return 0;
+}
+
+#endif
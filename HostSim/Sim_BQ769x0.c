@@ -0,0 +1,487 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Sim_BQ769x0.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Register level stand-in for the BQ769x0 AFE on the simulated I2C bus, with a simple pack behind
+ * it so the measurements and protections move the way the real part would
+----------------------------------------------------------------------------------------------------*/
+#ifdef BMS_HOST_SIM
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <math.h>
+#include "msp430.h"
+#include "Constants.h"
+#include "Sim_MCU.h"
+#include "Sim_BQ769x0.h"
+
+//----------------------------------------------------------------------------------------------------
+// What is modelled:
+// - Register map 0x00-0x59, pointer set by the first byte of a write, auto-increment on both reads
+//   and writes. SYS_STAT is write-1-to-clear, measurement and trim registers are read only.
+// - ADC and CC conversions every 250mS, CC_READY and the ALERT pin (high while any SYS_STAT bit is
+//   set, P1.1 on the board).
+// - OV/UV with the PROTECT3 delays, OCD with the PROTECT2 delay and SCD, evaluated once per
+//   conversion. A trip latches its SYS_STAT bit and drops the FET it protects, which then cannot
+//   be turned back on until the bit is cleared. Shorted cell inputs are left out of UV.
+// - I2C CRC when the firmware is built with I2C_BQ769xxCRC, a bad CRC on a write is NACKed and the
+//   byte dropped.
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define BQ_NUMREGS              0x5A
+#define BQ_LAST_CTRL            0x0B                //CC_CFG, last writable register
+#define BQ_CONV_MS              250
+#define BQ_TS_LSB_uV            382.0
+#define BQ_TS_PULLUP            10000.0
+#define BQ_TS_VREF              3.3
+#define BQ_NTC_R25              10000.0
+#define BQ_NTC_BETA             3435.0
+#define BQ_CC_LSB_nV            8440
+
+#define STAT_CC_READY           BIT7
+#define STAT_UV                 BIT3
+#define STAT_OV                 BIT2
+#define STAT_SCD                BIT1
+#define STAT_OCD                BIT0
+#define CTRL1_ADC_EN            BIT4
+#define CTRL1_TEMP_SEL          BIT3
+#define CTRL2_CC_EN             BIT6
+#define CTRL2_DSG_ON            BIT1
+#define CTRL2_CHG_ON            BIT0
+#define PROTECT1_RSNS           BIT7
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+SimPack_t Sim_Pack;
+
+static uint8_t Reg[BQ_NUMREGS];
+static uint8_t Ptr = 0;
+static bool FirstByte = false;
+static uint16_t OVTime_ms = 0;
+static uint16_t UVTime_ms = 0;
+static uint16_t OCDTime_ms = 0;
+static uint8_t Dropped = 0;                         //FETs opened on OV or UV, until it goes away
+
+#ifdef I2C_BQ769xxCRC
+static uint8_t CRC = 0;
+static bool CRCByte = false;
+static uint8_t WrData = 0;
+#endif
+
+static SimI2CDev_t BQDev;
+static SimTask_t BQTask;
+
+//Protection thresholds in mV across the sense resistor, RSNS=0 (the RSNS=1 values are double)
+static const uint8_t SCD_mV[8] = {22, 33, 44, 56, 67, 78, 89, 100};
+static const uint8_t OCD_mV[16] = {8, 11, 14, 17, 19, 22, 25, 28, 31, 33, 36, 39, 42, 44, 47, 50};
+static const uint16_t OCDDelay_ms[8] = {8, 20, 40, 80, 160, 320, 640, 1280};
+static const uint16_t OVDelay_ms[4] = {1000, 2000, 4000, 8000};
+static const uint16_t UVDelay_ms[4] = {1000, 4000, 8000, 16000};
+
+//Typical NMC cell, 0% to 100% in 10% steps
+static const uint16_t OCVDflt_mV[SIM_BQ_OCV_POINTS] =
+    {3000, 3450, 3550, 3610, 3660, 3710, 3780, 3860, 3950, 4050, 4180};
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static bool BQ_Start(SimI2CDev_t *dev, bool read);
+static bool BQ_Write(SimI2CDev_t *dev, uint8_t data);
+static uint8_t BQ_Read(SimI2CDev_t *dev);
+static void BQ_Stop(SimI2CDev_t *dev);
+static void BQ_Convert(SimTask_t *task);
+
+//------------------------------------------------------//--------------------------------------------
+void Sim_BQ_Init(void)
+{
+    static const uint8_t CellPos[PACK_NUM_CELLS] = PACK_CELL_POSITIONS;
+    uint8_t CT;
+
+    //Same topology the firmware is built for, inputs without a cell are shorted
+    Sim_Pack.Positions = AFE_NUM_POSITIONS;
+    Sim_Pack.ShortedMask = (1<<AFE_NUM_POSITIONS)-1;
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {   Sim_Pack.ShortedMask &= ~(1<<CellPos[CT]);  }
+    Sim_Pack.Capacity_mAh = 2500;
+    for(CT=0; CT<SIM_BQ_OCV_POINTS; CT++)
+    {   Sim_Pack.OCV_mV[CT] = OCVDflt_mV[CT];   }
+    Sim_Pack.RSense_uOhm = 10000;
+    Sim_Pack.CCOffset = 0;
+    Sim_Pack.Request_mA = 0;
+    Sim_Pack.BalBleed_mA = 50;
+    Sim_Pack.BalDrop_mV = 10;
+    Sim_Pack.BalAdjacent_CT = 0;
+    Sim_Pack.NackAll = false;
+    Sim_Pack.Ctrl2Write_CT = 0;
+    Sim_Pack.Ctrl2Write_Cycle = 0;
+    Sim_Pack.Reclose_CT = 0;
+    for(CT=0; CT<SIM_BQ_NUMTS; CT++)
+    {   Sim_Pack.Temp_dC[CT] = 250;     }
+    for(CT=0; CT<SIM_BQ_POSITIONS; CT++)
+    {   Sim_BQ_Set_SOC(CT, 500);
+        Sim_Pack.RCell_mOhm[CT] = 30;   }
+
+    for(CT=0; CT<BQ_NUMREGS; CT++)
+    {   Reg[CT] = 0;    }
+    Reg[REG_OV_TRIP] = 0xAC;
+    Reg[REGUV_TRIP] = 0x97;
+    Reg[REG_ADCGAIN1] = 0x04;                       //GAIN = 365 + 0b01111 = 380uV/LSB
+    Reg[REG_ADCOFFSET] = 0x05;                      //+5mV
+    Reg[REG_ADCGAIN2] = 0xE0;
+
+    BQDev.Addr = I2C_BQ769xxADDR;
+    BQDev.Start = BQ_Start;
+    BQDev.Write = BQ_Write;
+    BQDev.Read = BQ_Read;
+    BQDev.Stop = BQ_Stop;
+    Sim_I2C_Attach(&BQDev);
+
+    BQTask.Due = Sim_Now() + BQ_CONV_MS*SIM_CYCLES_PER_MS;
+    BQTask.Run = BQ_Convert;
+    Sim_Add_Task(&BQTask);
+}
+
+//----------------------------------------------------------------------------------------------------
+void Sim_BQ_Set_SOC(uint8_t pos, uint16_t permille)
+{   Sim_Pack.Charge_uAh[pos] = (int32_t)Sim_Pack.Capacity_mAh * permille;     }
+
+//----------------------------------------------------------------------------------------------------
+// Current actually flowing, the demand only gets through if the FET for its direction is on
+int32_t Sim_BQ_Get_Current_mA(void)
+{
+    if(Sim_Pack.Request_mA>0 && (Reg[REG_SYS_CTRL2] & CTRL2_CHG_ON))
+    {   return Sim_Pack.Request_mA;     }
+    if(Sim_Pack.Request_mA<0 && (Reg[REG_SYS_CTRL2] & CTRL2_DSG_ON))
+    {   return Sim_Pack.Request_mA;     }
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------------------
+uint16_t Sim_BQ_Get_Cell_mV(uint8_t pos)
+{
+    int32_t Pos;
+    int32_t Seg;
+    int32_t mV;
+
+    if(pos>=Sim_Pack.Positions || (Sim_Pack.ShortedMask & (1<<pos)))
+    {   return 0;   }
+
+    //Position on the curve in thousandths of a segment
+    Pos = (int64_t)Sim_Pack.Charge_uAh[pos]*(SIM_BQ_OCV_POINTS-1) / Sim_Pack.Capacity_mAh;
+    Seg = Pos/1000;
+    if(Seg>=SIM_BQ_OCV_POINTS-1)
+    {   Seg = SIM_BQ_OCV_POINTS-2;  }
+    mV = Sim_Pack.OCV_mV[Seg] + (int32_t)(Sim_Pack.OCV_mV[Seg+1]-Sim_Pack.OCV_mV[Seg]) *
+         (int32_t)(Pos-Seg*1000) / 1000;
+    mV += Sim_BQ_Get_Current_mA() * Sim_Pack.RCell_mOhm[pos] / 1000;
+    return (mV<0) ? 0 : mV;
+}
+
+//----------------------------------------------------------------------------------------------------
+// CEL_BAL1-3 as one mask of AFE inputs
+uint16_t Sim_BQ_Get_CB(void)
+{
+    return (Reg[REG_CEL_BAL1] & 0x1F) | ((uint16_t)(Reg[REG_CEL_BAL2] & 0x1F) << 5) |
+           ((uint16_t)(Reg[REG_CEL_BAL3] & 0x1F) << 10);
+}
+
+//----------------------------------------------------------------------------------------------------
+uint8_t Sim_BQ_Get_Reg(uint8_t reg)
+{   return (reg<BQ_NUMREGS) ? Reg[reg] : 0;   }
+
+//----------------------------------------------------------------------------------------------------
+// Moves the next conversion to cycle, the ones after it follow every 250mS from there. UINT64_MAX
+// holds the conversions until the next call.
+void Sim_BQ_Convert_At(uint64_t cycle)
+{   BQTask.Due = cycle;     }
+
+//----------------------------------------------------------------------------------------------------
+// Measurement and protection model
+//----------------------------------------------------------------------------------------------------
+static int32_t BQ_Gain_uV(void)
+{   return 365 + (((Reg[REG_ADCGAIN1] & 0x0C) << 1) | ((Reg[REG_ADCGAIN2] & 0xE0) >> 5));     }
+
+//----------------------------------------------------------------------------------------------------
+static void BQ_Put16(uint8_t reg, uint16_t val)
+{
+    Reg[reg] = val >> 8;
+    Reg[reg+1] = val & 0xFF;
+}
+
+//----------------------------------------------------------------------------------------------------
+static uint16_t BQ_Cell_ADC(uint8_t pos)
+{
+    uint16_t CB = Sim_BQ_Get_CB() & ~Sim_Pack.ShortedMask;
+    int32_t mV = Sim_BQ_Get_Cell_mV(pos);
+    int32_t ADC;
+
+    if(!(Sim_Pack.ShortedMask & (1<<pos)))
+    {
+        if(CB & (1<<pos))
+        {   mV -= Sim_Pack.BalDrop_mV;      }
+        if(CB & (2<<pos))
+        {   mV += Sim_Pack.BalDrop_mV/2;    }
+        if(pos && (CB & (1<<(pos-1))))
+        {   mV += Sim_Pack.BalDrop_mV/2;    }
+    }
+    ADC = (mV*1000 - (int8_t)Reg[REG_ADCOFFSET]*1000) / BQ_Gain_uV();
+
+    if(ADC<0)
+    {   ADC = 0;    }
+    if(ADC>0x3FFF)
+    {   ADC = 0x3FFF;   }
+    return ADC;
+}
+
+//----------------------------------------------------------------------------------------------------
+static uint16_t BQ_TS_ADC(uint8_t ts)
+{
+    double T = Sim_Pack.Temp_dC[ts]/10.0;
+    double V;
+    double R;
+
+    if(Reg[REG_SYS_CTRL1] & CTRL1_TEMP_SEL)
+    {   R = BQ_NTC_R25 * exp(BQ_NTC_BETA * (1.0/(T+273.15) - 1.0/298.15));
+        V = BQ_TS_VREF * R / (R + BQ_TS_PULLUP);                            }
+    else
+    {   V = 1.200 - 0.0042*(T-25.0);    }                                   //Die temperature
+
+    return (uint16_t)(V*1e6/BQ_TS_LSB_uV) & 0x3FFF;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void BQ_Update_Alert(void)
+{   Sim_Set_Pin(1, BIT1, Reg[REG_SYS_STAT]!=0);     }
+
+//----------------------------------------------------------------------------------------------------
+static void BQ_Trip(uint8_t stat)
+{
+    Reg[REG_SYS_STAT] |= stat;
+    if(stat & STAT_OV)
+    {   Reg[REG_SYS_CTRL2] &= ~CTRL2_CHG_ON;
+        Dropped |= CTRL2_CHG_ON;                }
+    if(stat & STAT_UV)
+    {   Dropped |= CTRL2_DSG_ON;    }
+    if(stat & (STAT_UV|STAT_SCD|STAT_OCD))
+    {   Reg[REG_SYS_CTRL2] &= ~CTRL2_DSG_ON;    }
+}
+
+//----------------------------------------------------------------------------------------------------
+static void BQ_Protect(void)
+{
+    uint16_t OVThresh = 0x2008 | ((uint16_t)Reg[REG_OV_TRIP] << 4);
+    uint16_t UVThresh = 0x1000 | ((uint16_t)Reg[REGUV_TRIP] << 4);
+    uint8_t Scale = (Reg[REG_PROTECT1] & PROTECT1_RSNS) ? 2 : 1;
+    int32_t Sense_uV = -Sim_BQ_Get_Current_mA() * (int32_t)Sim_Pack.RSense_uOhm / 1000;
+    bool OV = false;
+    bool UV = false;
+    uint16_t ADC;
+    uint8_t CT;
+
+    for(CT=0; CT<Sim_Pack.Positions; CT++)
+    {
+        ADC = BQ_Cell_ADC(CT);
+        if(ADC>OVThresh)
+        {   OV = true;  }
+        if(ADC<UVThresh && !(Sim_Pack.ShortedMask & (1<<CT)))
+        {   UV = true;  }
+    }
+
+    //Held at the longest delay, so a condition that lasts over a minute does not wrap and stop tripping
+    OVTime_ms = OV ? OVTime_ms+BQ_CONV_MS : 0;
+    UVTime_ms = UV ? UVTime_ms+BQ_CONV_MS : 0;
+    OVTime_ms = (OVTime_ms>OVDelay_ms[3]) ? OVDelay_ms[3] : OVTime_ms;
+    UVTime_ms = (UVTime_ms>UVDelay_ms[3]) ? UVDelay_ms[3] : UVTime_ms;
+    if(!OV)
+    {   Dropped &= ~CTRL2_CHG_ON;   }
+    if(!UV)
+    {   Dropped &= ~CTRL2_DSG_ON;   }
+    if(OVTime_ms>=OVDelay_ms[(Reg[REG_PROTECT3]>>4) & 0x03])
+    {   BQ_Trip(STAT_OV);   }
+    if(UVTime_ms>=UVDelay_ms[(Reg[REG_PROTECT3]>>6) & 0x03])
+    {   BQ_Trip(STAT_UV);   }
+
+    //Discharge only, Sense_uV is positive when current flows out of the pack
+    if(Sense_uV >= (int32_t)SCD_mV[Reg[REG_PROTECT1] & 0x07]*Scale*1000)
+    {   BQ_Trip(STAT_SCD);  }
+    if(Sense_uV >= (int32_t)OCD_mV[Reg[REG_PROTECT2] & 0x0F]*Scale*1000)
+    {   OCDTime_ms += BQ_CONV_MS;
+        if(OCDTime_ms>=OCDDelay_ms[(Reg[REG_PROTECT2]>>4) & 0x07])
+        {   BQ_Trip(STAT_OCD);  }       }
+    else
+    {   OCDTime_ms = 0;     }
+}
+
+//----------------------------------------------------------------------------------------------------
+// One 250mS conversion cycle: move charge, refresh the measurements and run the protections
+static void BQ_Convert(SimTask_t *task)
+{
+    int32_t I_mA = Sim_BQ_Get_Current_mA();
+    int32_t CC;
+    int32_t VBat_uV = 0;
+    uint16_t CB = Sim_BQ_Get_CB();
+    uint8_t Active = 0;
+    uint8_t CT;
+
+    if(CB & (CB>>1))
+    {   Sim_Pack.BalAdjacent_CT++;  }
+
+    for(CT=0; CT<Sim_Pack.Positions; CT++)
+    {
+        Sim_Pack.Charge_uAh[CT] += I_mA*BQ_CONV_MS/3600;
+        if(CB & (1<<CT))
+        {   Sim_Pack.Charge_uAh[CT] -= (int32_t)Sim_Pack.BalBleed_mA*BQ_CONV_MS/3600;    }
+        if(Sim_Pack.Charge_uAh[CT]<0)
+        {   Sim_Pack.Charge_uAh[CT] = 0;    }
+        if(Sim_Pack.Charge_uAh[CT] > (int32_t)Sim_Pack.Capacity_mAh*1000)
+        {   Sim_Pack.Charge_uAh[CT] = Sim_Pack.Capacity_mAh*1000;   }
+    }
+
+    if(Reg[REG_SYS_CTRL1] & CTRL1_ADC_EN)
+    {
+        for(CT=0; CT<SIM_BQ_POSITIONS; CT++)
+        {   BQ_Put16(REG_VCELL1+2*CT, (CT<Sim_Pack.Positions) ? BQ_Cell_ADC(CT) : 0);
+            VBat_uV += Sim_BQ_Get_Cell_mV(CT)*1000;
+            Active += (CT<Sim_Pack.Positions);                                      }
+        BQ_Put16(REG_VBATT, (VBat_uV - Active*(int8_t)Reg[REG_ADCOFFSET]*1000) / (4*BQ_Gain_uV()));
+        for(CT=0; CT<SIM_BQ_NUMTS; CT++)
+        {   BQ_Put16(REG_TS1+2*CT, BQ_TS_ADC(CT));  }
+        BQ_Protect();
+    }
+
+    if(Reg[REG_SYS_CTRL2] & CTRL2_CC_EN)
+    {
+        CC = I_mA * (int32_t)Sim_Pack.RSense_uOhm / BQ_CC_LSB_nV + Sim_Pack.CCOffset;
+        if(CC>32767)
+        {   CC = 32767;     }
+        if(CC<-32768)
+        {   CC = -32768;    }
+        BQ_Put16(REG_CCREG, (uint16_t)CC);
+        Reg[REG_SYS_STAT] |= STAT_CC_READY;
+    }
+
+    BQ_Update_Alert();
+    task->Due += BQ_CONV_MS*SIM_CYCLES_PER_MS;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Register writes, SYS_STAT clears the bits written as 1, a FET cannot be turned on while the
+// fault that dropped it is still latched. Turning on a FET that OV or UV dropped while the cell is
+// still past the threshold is counted as a reclose, whether or not SYS_STAT was cleared first.
+static void BQ_Store(uint8_t reg, uint8_t data)
+{
+    if(reg==REG_SYS_STAT)
+    {   Reg[REG_SYS_STAT] &= ~data;     }
+    else if(reg<=BQ_LAST_CTRL)
+    {
+        if(reg==REG_SYS_CTRL2)
+        {   Sim_Pack.Ctrl2Write_CT++;
+            Sim_Pack.Ctrl2Write_Cycle = Sim_Now();
+            if(data & ~Reg[REG_SYS_CTRL2] & Dropped)
+            {   Sim_Pack.Reclose_CT++;  }
+            if(Reg[REG_SYS_STAT] & STAT_OV)
+            {   data &= ~CTRL2_CHG_ON;  }
+            if(Reg[REG_SYS_STAT] & (STAT_UV|STAT_SCD|STAT_OCD))
+            {   data &= ~CTRL2_DSG_ON;  }       }
+        Reg[reg] = data;
+    }
+    BQ_Update_Alert();
+}
+
+//----------------------------------------------------------------------------------------------------
+// I2C device
+//----------------------------------------------------------------------------------------------------
+#ifdef I2C_BQ769xxCRC
+static uint8_t BQ_CRC8(uint8_t crc, uint8_t data)
+{
+    uint8_t CT;
+
+    crc ^= data;
+    for(CT=0; CT<8; CT++)
+    {   crc = (crc & 0x80) ? (uint8_t)((crc<<1) ^ 0x07) : (uint8_t)(crc<<1);  }
+    return crc;
+}
+#endif
+
+//----------------------------------------------------------------------------------------------------
+static bool BQ_Start(SimI2CDev_t *dev, bool read)
+{
+    if(Sim_Pack.NackAll)
+    {   return false;   }
+
+    FirstByte = !read;
+#ifdef I2C_BQ769xxCRC
+    CRC = BQ_CRC8(0, (dev->Addr<<1) | (read ? 1 : 0));
+    CRCByte = false;
+#else
+    (void)dev;
+#endif
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------
+static bool BQ_Write(SimI2CDev_t *dev, uint8_t data)
+{
+    (void)dev;
+    if(Sim_Pack.NackAll)
+    {   return false;   }
+
+    if(FirstByte)
+    {   Ptr = data;
+        FirstByte = false;
+#ifdef I2C_BQ769xxCRC
+        CRC = BQ_CRC8(CRC, data);
+#endif
+        return true;            }
+
+#ifdef I2C_BQ769xxCRC
+    //Data byte then its CRC, the first CRC also covers the address and register bytes
+    if(!CRCByte)
+    {   WrData = data;
+        CRC = BQ_CRC8(CRC, data);
+        CRCByte = true;
+        return true;            }
+    CRCByte = false;
+    if(data!=CRC)
+    {   CRC = 0;
+        return false;   }
+    CRC = 0;
+    data = WrData;
+#endif
+
+    BQ_Store(Ptr++, data);
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------
+static uint8_t BQ_Read(SimI2CDev_t *dev)
+{
+    uint8_t Data;
+
+    (void)dev;
+#ifdef I2C_BQ769xxCRC
+    if(CRCByte)
+    {   Data = CRC;
+        CRC = 0;
+        CRCByte = false;
+        return Data;        }
+#endif
+
+    Data = (Ptr<BQ_NUMREGS) ? Reg[Ptr] : 0;
+    Ptr++;
+#ifdef I2C_BQ769xxCRC
+    CRC = BQ_CRC8(CRC, Data);
+    CRCByte = true;
+#endif
+    return Data;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void BQ_Stop(SimI2CDev_t *dev)
+{
+    (void)dev;
+    FirstByte = false;
+}
+
+#endif
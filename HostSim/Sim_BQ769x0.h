@@ -0,0 +1,63 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Sim_BQ769x0.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Register level stand-in for the BQ769x0 AFE on the simulated I2C bus, with a simple pack behind
+ * it so the measurements and protections move the way the real part would
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef SIM_BQ769X0_H
+#define SIM_BQ769X0_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define SIM_BQ_POSITIONS        15                  //Cell inputs on the largest part (BQ76940)
+#define SIM_BQ_NUMTS            3
+#define SIM_BQ_OCV_POINTS       11
+
+//----------------------------------------------------------------------------------------------------
+// Pack behind the AFE. Cells follow a piecewise linear OCV curve (SIM_BQ_OCV_POINTS points, 0% to
+// 100%) over their state of charge plus an IR drop, current only flows in a direction whose FET
+// is on. Positive current is charge. A balanced cell loses BalBleed_mA and its reading is off by
+// BalDrop_mV while CB is set, the way the input filter resistors make it on the board.
+typedef struct
+{
+    uint8_t Positions;                              //Cell inputs on this part (AFE_NUM_POSITIONS)
+    uint16_t ShortedMask;                           //Inputs shorted on the board, read ~0V
+    uint32_t Capacity_mAh;
+    uint16_t OCV_mV[SIM_BQ_OCV_POINTS];
+    uint16_t RCell_mOhm[SIM_BQ_POSITIONS];
+    uint32_t RSense_uOhm;
+    int16_t CCOffset;                               //CC counts read with no current
+    int32_t Request_mA;                             //Charger/load demand, before the FETs
+    int16_t Temp_dC[SIM_BQ_NUMTS];                  //0.1C
+    int32_t Charge_uAh[SIM_BQ_POSITIONS];           //Per cell, so imbalance can be set up
+    uint16_t BalBleed_mA;                           //Bleed current of a balanced cell
+    uint16_t BalDrop_mV;                            //Its reading error, neighbours read half high
+    uint32_t BalAdjacent_CT;                        //Conversions with adjacent CB bits set
+    bool NackAll;                                   //Fault injection, stop answering on the bus
+    uint32_t Ctrl2Write_CT;                         //SYS_CTRL2 writes seen, and when the last was
+    uint64_t Ctrl2Write_Cycle;
+    uint32_t Reclose_CT;                            //Of them, ones that turned a FET back on while
+                                                    //the OV or UV that dropped it is still there
+} SimPack_t;
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void Sim_BQ_Init(void);
+void Sim_BQ_Set_SOC(uint8_t pos, uint16_t permille);
+uint16_t Sim_BQ_Get_Cell_mV(uint8_t pos);
+uint16_t Sim_BQ_Get_CB(void);
+int32_t Sim_BQ_Get_Current_mA(void);
+uint8_t Sim_BQ_Get_Reg(uint8_t reg);
+void Sim_BQ_Convert_At(uint64_t cycle);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern SimPack_t Sim_Pack;
+
+#endif
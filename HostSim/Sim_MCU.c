@@ -0,0 +1,816 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Sim_MCU.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Host simulator for the MSP430FR2155 peripherals the firmware uses: the clock, Timer0_B3 and
+ * Timer1_B3, port 1/2 pin interrupts and eUSCI_B0 as an I2C master, plus the interrupt dispatch
+ * that ties them to the ISRs in the firmware. Devices on the I2C bus and anything else that needs
+ * to run on simulated time plug in through the interfaces in Sim_MCU.h.
+----------------------------------------------------------------------------------------------------*/
+#ifdef BMS_HOST_SIM
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <stdio.h>
+#include <stdlib.h>
+#include "msp430.h"
+#include "Sim_MCU.h"
+
+//----------------------------------------------------------------------------------------------------
+// How the simulation runs:
+// Firmware code takes no simulated time, the clock only moves while the firmware sleeps in LPM0,
+// spins in __delay_cycles(), polls a register with side effects or is entering/leaving an ISR.
+// While the clock moves every peripheral is brought up to date and, if GIE is set and no ISR is
+// running, pending interrupts are dispatched by calling the ISR functions directly. Time jumps
+// straight to the next scheduled event (timer compare, I2C byte boundary, task) so an idle second
+// of simulated time costs next to nothing.
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define ISR_ENTRY_CYCLES        6
+#define ISR_EXIT_CYCLES         5
+#define REG_POLL_CYCLES         4
+#define TXBUF_EMPTY             0xFFFF      //UCB0TXBUF holds this until the firmware writes a byte
+
+//----------------------------------------------------------------------------------------------------
+// Registers
+#define SIM_DEF8(name)          volatile uint8_t name;
+#define SIM_DEF16(name)         volatile uint16_t name;
+
+SIM_DEF8(P1IN)  SIM_DEF8(P1OUT) SIM_DEF8(P1DIR) SIM_DEF8(P1REN) SIM_DEF8(P1SEL0) SIM_DEF8(P1SEL1)
+SIM_DEF8(P1IES) SIM_DEF8(P1IE)  SIM_DEF8(P1IFG)
+SIM_DEF8(P2IN)  SIM_DEF8(P2OUT) SIM_DEF8(P2DIR) SIM_DEF8(P2REN) SIM_DEF8(P2SEL0) SIM_DEF8(P2SEL1)
+SIM_DEF8(P2IES) SIM_DEF8(P2IE)  SIM_DEF8(P2IFG)
+SIM_DEF8(P3IN)  SIM_DEF8(P3OUT) SIM_DEF8(P3DIR) SIM_DEF8(P3REN) SIM_DEF8(P3SEL0)
+SIM_DEF8(P4IN)  SIM_DEF8(P4OUT) SIM_DEF8(P4DIR) SIM_DEF8(P4REN) SIM_DEF8(P4SEL0)
+
+SIM_DEF16(PM5CTL0)  SIM_DEF16(WDTCTL)   SIM_DEF16(SYSCFG0)  SIM_DEF16(FRCTL0)
+SIM_DEF16(CSCTL0)   SIM_DEF16(CSCTL1)   SIM_DEF16(CSCTL2)   SIM_DEF16(CSCTL3)
+SIM_DEF16(CSCTL4)   SIM_DEF16(CSCTL5)   SIM_DEF16(CSCTL6)   SIM_DEF16(CSCTL7)
+
+SIM_DEF16(Sim_UCB0CTLW0) SIM_DEF16(UCB0CTLW1) SIM_DEF16(UCB0BRW)  SIM_DEF16(UCB0STATW)
+SIM_DEF16(UCB0TBCNT)     SIM_DEF16(UCB0RXBUF) SIM_DEF16(UCB0TXBUF) SIM_DEF16(UCB0I2CSA)
+SIM_DEF16(UCB0IE)        SIM_DEF16(UCB0IFG)
+
+SIM_DEF16(UCA0CTLW0) SIM_DEF16(UCA0MCTLW) SIM_DEF16(UCA0IE) SIM_DEF16(UCA0IFG)
+SIM_DEF16(UCA0RXBUF) SIM_DEF16(UCA0TXBUF) SIM_DEF8(UCA0BR0) SIM_DEF8(UCA0BR1)
+
+SIM_DEF16(TB0CTL)   SIM_DEF16(TB0CCTL0) SIM_DEF16(TB0CCTL1) SIM_DEF16(TB0CCTL2)
+SIM_DEF16(TB0CCR0)  SIM_DEF16(TB0CCR1)  SIM_DEF16(TB0CCR2)  SIM_DEF16(TB0EX0)
+SIM_DEF16(TB1CTL)   SIM_DEF16(TB1CCTL0) SIM_DEF16(TB1CCTL1) SIM_DEF16(TB1CCTL2)
+SIM_DEF16(TB1CCR0)  SIM_DEF16(TB1CCR1)  SIM_DEF16(TB1CCR2)  SIM_DEF16(TB1EX0)
+
+static volatile uint16_t TB0R_Val;
+static volatile uint16_t TB1R_Val;
+
+//----------------------------------------------------------------------------------------------------
+// Firmware interrupt service routines
+extern void TIMER0_B1_ISR(void);
+extern void TIMER1_B1_ISR(void);
+extern void USCIB0_ISR(void);
+extern void Port_1(void);
+
+//----------------------------------------------------------------------------------------------------
+// Structs and Enumerations
+typedef struct
+{
+    volatile uint16_t *CTL;
+    volatile uint16_t *CCTL[3];
+    volatile uint16_t *CCR[3];
+    volatile uint16_t *R;
+    uint64_t StartTick;                             //Source clock ticks when the count was zero
+    uint64_t LastT;                                 //Counts processed so far
+    bool Running;
+} SimTimer_t;
+
+typedef enum
+{
+    BUS_IDLE,
+    BUS_ADDR,                                       //Address byte going out
+    BUS_TX_WAIT,                                    //Waiting on the firmware for TXBUF/STT/STP
+    BUS_TX_BYTE,
+    BUS_RX_BYTE,
+    BUS_RX_WAIT,                                    //SCL stretched until RXBUF is read
+    BUS_HOLD,                                       //NACKed, waiting on the firmware for STT/STP
+    BUS_STOP
+} SimBus_t;
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+SimStats_t Sim_Stats;
+void (*Sim_OnEnd)(void) = 0;
+
+static uint64_t Cycle = 0;
+static uint64_t EndCycle = UINT64_MAX;
+static bool GIE_On = false;
+static bool InISR = false;
+static bool WakeReq = false;
+
+static SimTask_t *Tasks = 0;
+static SimI2CDev_t *Devs = 0;
+static uint8_t PinsIn[5];
+
+static SimTimer_t Timer0 = {&TB0CTL, {&TB0CCTL0, &TB0CCTL1, &TB0CCTL2},
+                            {&TB0CCR0, &TB0CCR1, &TB0CCR2}, &TB0R_Val, 0, 0, false};
+static SimTimer_t Timer1 = {&TB1CTL, {&TB1CCTL0, &TB1CCTL1, &TB1CCTL2},
+                            {&TB1CCR0, &TB1CCR1, &TB1CCR2}, &TB1R_Val, 0, 0, false};
+
+static SimBus_t Bus = BUS_IDLE;
+static uint64_t BusEnd = 0;
+static SimI2CDev_t *BusDev = 0;
+static uint8_t BusShift = 0;
+static uint8_t BusCount = 0;
+
+//Bus log, every START to STOP or repeated start is printed while the clock is before LogUntil
+#define LOG_BYTES               4
+static uint64_t LogUntil = 0;
+static uint64_t LogStart = 0;
+static bool LogOpen = false;
+static bool LogRead = false;
+static uint8_t LogAddr = 0;
+static uint8_t LogData[LOG_BYTES];
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static void Sim_Update(void);
+static void Sim_Dispatch(void);
+static void Sim_RunUntil(uint64_t target, bool stopOnWake);
+static uint64_t Sim_NextEvent(void);
+static void Sim_End(void);
+static void Bus_Log(void);
+
+//------------------------------------------------------//--------------------------------------------
+void Sim_MCU_Reset(void)
+{
+    Cycle = 0;
+    GIE_On = false;
+    InISR = false;
+    WakeReq = false;
+
+    PinsIn[1] = BIT2 | BIT3;                        //I2C pulled up, ALERT low
+    PinsIn[2] = BIT2 | BIT3;                        //Buttons pulled up (released)
+    PinsIn[3] = 0;
+    PinsIn[4] = 0;
+    P1IN = PinsIn[1];
+    P2IN = PinsIn[2];
+
+    Sim_UCB0CTLW0 = UCSWRST;
+    UCB0TXBUF = TXBUF_EMPTY;
+}
+
+//----------------------------------------------------------------------------------------------------
+void Sim_Set_EndCycle(uint64_t cycle)
+{   EndCycle = cycle;   }
+
+//----------------------------------------------------------------------------------------------------
+uint64_t Sim_Now(void)
+{   return Cycle;   }
+
+//----------------------------------------------------------------------------------------------------
+void Sim_I2C_Attach(SimI2CDev_t *dev)
+{
+    dev->Next = Devs;
+    Devs = dev;
+}
+
+//----------------------------------------------------------------------------------------------------
+void Sim_Add_Task(SimTask_t *task)
+{
+    task->Next = Tasks;
+    Tasks = task;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Drive an input pin from outside, port 1/2 pin interrupts are flagged on the edge selected by PxIES
+void Sim_Set_Pin(uint8_t port, uint8_t bit, bool level)
+{
+    uint8_t Old = PinsIn[port];
+    bool Rising;
+
+    if(level)
+    {   PinsIn[port] |= bit;    }
+    else
+    {   PinsIn[port] &= ~bit;   }
+    if(Old==PinsIn[port])
+    {   return;     }
+
+    Rising = level;
+    if(port==1)
+    {   if(Rising != ((P1IES & bit)!=0))
+        {   P1IFG |= bit;   }
+        P1IN = PinsIn[1];                   }
+    else if(port==2)
+    {   if(Rising != ((P2IES & bit)!=0))
+        {   P2IFG |= bit;   }
+        P2IN = PinsIn[2];                   }
+    else if(port==3)
+    {   P3IN = PinsIn[3];   }
+    else if(port==4)
+    {   P4IN = PinsIn[4];   }
+}
+
+//----------------------------------------------------------------------------------------------------
+void Sim_Report(void)
+{
+    printf("sim time          %.3f s\n", (double)Cycle/SIM_MCLK_HZ);
+    printf("time asleep       %.1f %%\n", Cycle ? 100.0*Sim_Stats.Sleep_Cycles/Cycle : 0.0);
+    printf("ISRs              TB0 %lu, TB1 %lu, USCI_B0 %lu, PORT1 %lu\n", Sim_Stats.ISR_CT[0],
+           Sim_Stats.ISR_CT[1], Sim_Stats.ISR_CT[2], Sim_Stats.ISR_CT[3]);
+    printf("I2C               %lu starts, %lu bytes, %lu NACKs\n", Sim_Stats.I2C_Start_CT,
+           Sim_Stats.I2C_Byte_CT, Sim_Stats.I2C_NACK_CT);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Print every I2C transfer for the next cycles, one line per START (or repeated start): the time
+// it went out, address, direction and the first LOG_BYTES bytes written or the number read. A
+// transfer already on the bus is printed as well.
+void Sim_Log_For(uint64_t cycles)
+{
+    LogUntil = Cycle + cycles;
+    LogOpen = (Bus!=BUS_IDLE);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Timer_B model
+//----------------------------------------------------------------------------------------------------
+static uint64_t Timer_SrcTicks(SimTimer_t *t, uint64_t cycle)
+{
+    if((*t->CTL & TBSSEL_2)==TBSSEL_2)
+    {   return cycle;   }
+    return (cycle*SIM_ACLK_HZ)/SIM_MCLK_HZ;
+}
+
+//----------------------------------------------------------------------------------------------------
+static uint64_t Timer_SrcToCycle(SimTimer_t *t, uint64_t ticks)
+{
+    if((*t->CTL & TBSSEL_2)==TBSSEL_2)
+    {   return ticks;   }
+    return (ticks*SIM_MCLK_HZ + SIM_ACLK_HZ-1)/SIM_ACLK_HZ;
+}
+
+//----------------------------------------------------------------------------------------------------
+static uint64_t Timer_Div(SimTimer_t *t)
+{   return 1ULL << ((*t->CTL & ID_3) >> 6);     }
+
+//----------------------------------------------------------------------------------------------------
+static uint64_t Timer_Period(SimTimer_t *t)
+{   return ((*t->CTL & MC_3)==MC_1) ? (uint64_t)*t->CCR[0]+1 : 65536;     }
+
+//----------------------------------------------------------------------------------------------------
+// First count after 'after' where the counter equals val, counting modulo period
+static uint64_t Timer_NextHit(uint64_t after, uint64_t val, uint64_t period)
+{
+    uint64_t First = after+1;
+    return First + (val + period - (First % period)) % period;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Timer_Update(SimTimer_t *t)
+{
+    uint64_t NowT;
+    uint64_t Period;
+    uint8_t CT;
+
+    if(*t->CTL & TBCLR)
+    {   *t->CTL &= ~TBCLR;
+        t->StartTick = Timer_SrcTicks(t, Cycle);
+        t->LastT = 0;
+        *t->R = 0;                                  }
+
+    if((*t->CTL & MC_3)==MC_0)
+    {   t->Running = false;
+        return;             }
+    if(!t->Running)
+    {   t->StartTick = Timer_SrcTicks(t, Cycle) - t->LastT*Timer_Div(t);
+        t->Running = true;      }
+
+    NowT = (Timer_SrcTicks(t, Cycle) - t->StartTick) / Timer_Div(t);
+    Period = Timer_Period(t);
+    if(NowT>t->LastT)
+    {
+        for(CT=0; CT<3; CT++)
+        {   if(*t->CCR[CT]<Period && Timer_NextHit(t->LastT, *t->CCR[CT], Period)<=NowT)
+            {   *t->CCTL[CT] |= CCIFG;  }           }
+        if(Timer_NextHit(t->LastT, 0, Period)<=NowT)
+        {   *t->CTL |= TBIFG;   }
+        t->LastT = NowT;
+    }
+    *t->R = NowT % Period;
+}
+
+//----------------------------------------------------------------------------------------------------
+static uint64_t Timer_NextEvent(SimTimer_t *t)
+{
+    uint64_t Next = UINT64_MAX;
+    uint64_t Period = Timer_Period(t);
+    uint64_t Hit;
+    uint8_t CT;
+
+    if(!t->Running)
+    {   return Next;    }
+
+    for(CT=1; CT<3; CT++)
+    {
+        if((*t->CCTL[CT] & CCIE) && !(*t->CCTL[CT] & CCIFG) && *t->CCR[CT]<Period)
+        {   Hit = Timer_NextHit(t->LastT, *t->CCR[CT], Period);
+            Hit = Timer_SrcToCycle(t, t->StartTick + Hit*Timer_Div(t));
+            if(Hit<Next)
+            {   Next = Hit;     }                                       }
+    }
+    if((*t->CTL & TBIE) && !(*t->CTL & TBIFG))
+    {   Hit = Timer_NextHit(t->LastT, 0, Period);
+        Hit = Timer_SrcToCycle(t, t->StartTick + Hit*Timer_Div(t));
+        if(Hit<Next)
+        {   Next = Hit;     }                                           }
+    return Next;
+}
+
+//----------------------------------------------------------------------------------------------------
+static bool Timer_Pending(SimTimer_t *t)
+{
+    return ((*t->CCTL[1] & (CCIE|CCIFG))==(CCIE|CCIFG)) ||
+           ((*t->CCTL[2] & (CCIE|CCIFG))==(CCIE|CCIFG)) ||
+           ((*t->CTL & (TBIE|TBIFG))==(TBIE|TBIFG));
+}
+
+//----------------------------------------------------------------------------------------------------
+// TBxIV, highest priority enabled flag, reading it clears that flag
+static uint16_t Timer_IV(SimTimer_t *t)
+{
+    Sim_Update();
+    if((*t->CCTL[1] & (CCIE|CCIFG))==(CCIE|CCIFG))
+    {   *t->CCTL[1] &= ~CCIFG;
+        return TB0IV_TBCCR1;        }
+    if((*t->CCTL[2] & (CCIE|CCIFG))==(CCIE|CCIFG))
+    {   *t->CCTL[2] &= ~CCIFG;
+        return TB0IV_TBCCR2;        }
+    if((*t->CTL & (TBIE|TBIFG))==(TBIE|TBIFG))
+    {   *t->CTL &= ~TBIFG;
+        return TB0IV_TBIFG;         }
+    return TB0IV_NONE;
+}
+
+//----------------------------------------------------------------------------------------------------
+// eUSCI_B0 I2C master model
+//----------------------------------------------------------------------------------------------------
+static uint64_t Bus_ByteCycles(void)
+{   return 9ULL * (UCB0BRW ? UCB0BRW : 1);  }      //SMCLK = MCLK, 8 data bits and the ACK
+
+//----------------------------------------------------------------------------------------------------
+static bool Bus_AutoStop(void)
+{   return ((UCB0CTLW1 & UCASTP_3)==UCASTP_2) && UCB0TBCNT && BusCount>=UCB0TBCNT;    }
+
+//----------------------------------------------------------------------------------------------------
+static SimI2CDev_t *Bus_Find(uint8_t addr)
+{
+    SimI2CDev_t *Dev = Devs;
+
+    while(Dev && Dev->Addr!=addr)
+    {   Dev = Dev->Next;    }
+    return Dev;
+}
+
+//----------------------------------------------------------------------------------------------------
+// START or repeated start, the direction comes from UCTR. TXIFG is raised right away so the first
+// byte can be loaded while the address goes out.
+static void Bus_Start(void)
+{
+    Bus_Log();
+    LogOpen = (Cycle<LogUntil);
+    LogStart = Cycle;
+    LogAddr = UCB0I2CSA & 0x7F;
+    LogRead = !(Sim_UCB0CTLW0 & UCTR);
+
+    if(Sim_UCB0CTLW0 & UCTR)
+    {   UCB0IFG |= UCTXIFG0;    }
+    UCB0STATW |= UCBBUSY;
+    BusCount = 0;
+    Bus = BUS_ADDR;
+    BusEnd = Cycle + Bus_ByteCycles();
+    Sim_Stats.I2C_Start_CT++;
+}
+
+//----------------------------------------------------------------------------------------------------
+// The segment started by the last START is over, print it if it is in the log window
+static void Bus_Log(void)
+{
+    uint8_t CT;
+
+    if(!LogOpen)
+    {   return;     }
+    LogOpen = false;
+
+    printf("%10.3f ms  I2C 0x%02X %c", (double)LogStart*1000/SIM_MCLK_HZ, LogAddr,
+           LogRead ? 'R' : 'W');
+    if(LogRead)
+    {   printf(" %u bytes\n", BusCount);
+        return;                         }
+    for(CT=0; CT<BusCount && CT<LOG_BYTES; CT++)
+    {   printf(" %02X", LogData[CT]);   }
+    if(BusCount>LOG_BYTES)
+    {   printf(" .. (%u bytes)", BusCount); }
+    printf("\n");
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Bus_Stop(void)
+{
+    Bus = BUS_STOP;
+    BusEnd = Cycle + Bus_ByteCycles()/9*2;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Bus_Nack(void)
+{
+    UCB0IFG |= UCNACKIFG;
+    UCB0IFG &= ~UCTXIFG0;
+    Bus = BUS_HOLD;
+    Sim_Stats.I2C_NACK_CT++;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Bus_Update(void)
+{
+    bool Again = true;
+
+    //Reset clears the interrupt enables and flags and drops whatever was on the bus
+    if(Sim_UCB0CTLW0 & UCSWRST)
+    {
+        if(BusDev)
+        {   BusDev->Stop(BusDev);   }
+        Bus_Log();
+        BusDev = 0;
+        Bus = BUS_IDLE;
+        UCB0IE = 0;
+        UCB0IFG = 0;
+        UCB0STATW = 0;
+        Sim_UCB0CTLW0 &= ~(UCTXSTT|UCTXSTP);
+        UCB0TXBUF = TXBUF_EMPTY;
+        return;
+    }
+
+    while(Again)
+    {
+        Again = false;
+        switch(Bus)
+        {
+            case BUS_IDLE:
+            case BUS_HOLD:
+                if(Sim_UCB0CTLW0 & UCTXSTT)
+                {   Bus_Start();
+                    Again = true;           }
+                else if(Sim_UCB0CTLW0 & UCTXSTP)
+                {   if(Bus==BUS_HOLD)
+                    {   Bus_Stop();
+                        Again = true;       }
+                    else
+                    {   Sim_UCB0CTLW0 &= ~UCTXSTP;  }       }
+                break;
+
+            case BUS_ADDR:
+                if(Cycle<BusEnd)
+                {   break;  }
+                Sim_UCB0CTLW0 &= ~UCTXSTT;
+                BusDev = Bus_Find(UCB0I2CSA & 0x7F);
+                if(!BusDev || !BusDev->Start(BusDev, !(Sim_UCB0CTLW0 & UCTR)))
+                {   BusDev = 0;
+                    Bus_Nack();                         }
+                else if(Sim_UCB0CTLW0 & UCTR)
+                {   Bus = BUS_TX_WAIT;      }
+                else
+                {   Bus = BUS_RX_BYTE;
+                    BusEnd = Cycle + Bus_ByteCycles();  }
+                Again = true;
+                break;
+
+            case BUS_TX_WAIT:
+                if(UCB0TXBUF!=TXBUF_EMPTY)
+                {   BusShift = UCB0TXBUF;
+                    UCB0TXBUF = TXBUF_EMPTY;
+                    UCB0IFG |= UCTXIFG0;
+                    Bus = BUS_TX_BYTE;
+                    BusEnd = Cycle + Bus_ByteCycles();
+                    Again = true;                       }
+                else if(Sim_UCB0CTLW0 & UCTXSTT)
+                {   Bus_Start();
+                    Again = true;                       }
+                else if(Sim_UCB0CTLW0 & UCTXSTP)
+                {   Bus_Stop();
+                    Again = true;                       }
+                break;
+
+            case BUS_TX_BYTE:
+                if(Cycle<BusEnd)
+                {   break;  }
+                Sim_Stats.I2C_Byte_CT++;
+                if(BusCount<LOG_BYTES)
+                {   LogData[BusCount] = BusShift;   }
+                BusCount++;
+                if(!BusDev->Write(BusDev, BusShift))
+                {   Bus_Nack();     }
+                else if(Bus_AutoStop())
+                {   UCB0IFG |= UCBCNTIFG;
+                    Bus_Stop();     }
+                else
+                {   Bus = BUS_TX_WAIT;  }
+                Again = true;
+                break;
+
+            case BUS_RX_BYTE:
+                if(Cycle<BusEnd)
+                {   break;  }
+                Sim_Stats.I2C_Byte_CT++;
+                BusCount++;
+                UCB0RXBUF = BusDev->Read(BusDev);
+                UCB0IFG |= UCRXIFG0;
+                if(Bus_AutoStop())
+                {   UCB0IFG |= UCBCNTIFG;
+                    Bus_Stop();     }
+                else if(Sim_UCB0CTLW0 & UCTXSTP)
+                {   Bus_Stop();     }
+                else
+                {   Bus = BUS_RX_WAIT;  }
+                Again = true;
+                break;
+
+            case BUS_RX_WAIT:
+                if(UCB0IFG & UCRXIFG0)
+                {   break;  }
+                if(Sim_UCB0CTLW0 & UCTXSTT)
+                {   Bus_Start();    }
+                else
+                {   Bus = BUS_RX_BYTE;
+                    BusEnd = Cycle + Bus_ByteCycles();  }
+                Again = true;
+                break;
+
+            case BUS_STOP:
+                if(Cycle<BusEnd)
+                {   break;  }
+                Sim_UCB0CTLW0 &= ~UCTXSTP;
+                UCB0STATW &= ~UCBBUSY;
+                UCB0IFG |= UCSTPIFG;
+                Bus_Log();
+                if(BusDev)
+                {   BusDev->Stop(BusDev);   }
+                BusDev = 0;
+                Bus = BUS_IDLE;
+                Again = true;
+                break;
+        }
+    }
+
+    UCB0STATW = (UCB0STATW & 0x00FF) | ((uint16_t)BusCount << 8);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Interrupt vector register for eUSCI_B0, highest priority enabled flag, reading it clears the flag
+static uint16_t Bus_IV(void)
+{
+    static const struct { uint16_t Flag; uint16_t Vector; } Order[] =
+    {
+        {UCALIFG, USCI_I2C_UCALIFG},    {UCNACKIFG, USCI_I2C_UCNACKIFG},
+        {UCSTTIFG, USCI_I2C_UCSTTIFG},  {UCSTPIFG, USCI_I2C_UCSTPIFG},
+        {UCRXIFG0, USCI_I2C_UCRXIFG0},  {UCTXIFG0, USCI_I2C_UCTXIFG0},
+        {UCBCNTIFG, USCI_I2C_UCBCNTIFG}, {UCCLTOIFG, USCI_I2C_UCCLTOIFG}
+    };
+    uint8_t CT;
+
+    Sim_Update();
+    for(CT=0; CT<sizeof(Order)/sizeof(Order[0]); CT++)
+    {
+        if(UCB0IE & UCB0IFG & Order[CT].Flag)
+        {   UCB0IFG &= ~Order[CT].Flag;
+            return Order[CT].Vector;    }
+    }
+    return USCI_NONE;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Core: time, events and interrupt dispatch
+//----------------------------------------------------------------------------------------------------
+static void Sim_Update(void)
+{
+    SimTask_t *Task;
+
+    if(Cycle>=EndCycle)
+    {   Sim_End();  }
+
+    for(Task=Tasks; Task; Task=Task->Next)
+    {   while(Task->Due<=Cycle)
+        {   Task->Run(Task);    }   }
+
+    Timer_Update(&Timer0);
+    Timer_Update(&Timer1);
+    Bus_Update();
+
+    //The firmware only ever reads these, undo any stray writes
+    P1IN = PinsIn[1];
+    P2IN = PinsIn[2];
+}
+
+//----------------------------------------------------------------------------------------------------
+static uint64_t Sim_NextEvent(void)
+{
+    uint64_t Next = UINT64_MAX;
+    uint64_t Event;
+    SimTask_t *Task;
+
+    for(Task=Tasks; Task; Task=Task->Next)
+    {   if(Task->Due<Next)
+        {   Next = Task->Due;   }   }
+
+    Event = Timer_NextEvent(&Timer0);
+    if(Event<Next)
+    {   Next = Event;   }
+    Event = Timer_NextEvent(&Timer1);
+    if(Event<Next)
+    {   Next = Event;   }
+
+    if(Bus==BUS_ADDR || Bus==BUS_TX_BYTE || Bus==BUS_RX_BYTE || Bus==BUS_STOP)
+    {   if(BusEnd<Next)
+        {   Next = BusEnd;  }   }
+
+    return Next;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Run pending interrupts one at a time in priority order, no nesting (GIE is clear inside an ISR)
+static void Sim_Dispatch(void)
+{
+    void (*Isr)(void);
+    uint8_t Idx;
+
+    while(GIE_On && !InISR)
+    {
+        Sim_Update();
+        if(Timer_Pending(&Timer0))
+        {   Isr = TIMER0_B1_ISR;    Idx = 0;    }
+        else if(Timer_Pending(&Timer1))
+        {   Isr = TIMER1_B1_ISR;    Idx = 1;    }
+        else if(UCB0IE & UCB0IFG)
+        {   Isr = USCIB0_ISR;       Idx = 2;    }
+        else if(P1IE & P1IFG)
+        {   Isr = Port_1;           Idx = 3;    }
+        else
+        {   break;  }
+
+        InISR = true;
+        Cycle += ISR_ENTRY_CYCLES;
+        Isr();
+        Cycle += ISR_EXIT_CYCLES;
+        InISR = false;
+        Sim_Stats.ISR_CT[Idx]++;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Move the clock forward to target, or until an ISR asks to leave LPM0 if stopOnWake is set
+static void Sim_RunUntil(uint64_t target, bool stopOnWake)
+{
+    uint64_t Next;
+
+    for(;;)
+    {
+        Sim_Update();
+        if(GIE_On && !InISR)
+        {   Sim_Dispatch();     }
+        if(stopOnWake && WakeReq)
+        {   return;     }
+        if(Cycle>=target)
+        {   return;     }
+
+        Next = Sim_NextEvent();
+        if(Next>target)
+        {   Next = target;  }
+        if(Next>EndCycle)
+        {   Next = EndCycle;    }
+        if(Next<=Cycle)
+        {   Next = Cycle+1;     }
+        if(stopOnWake)
+        {   Sim_Stats.Sleep_Cycles += Next-Cycle;   }
+        Cycle = Next;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Sim_End(void)
+{
+    if(Sim_OnEnd)
+    {   Sim_OnEnd();    }
+    exit(0);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Registers with side effects
+//----------------------------------------------------------------------------------------------------
+volatile uint16_t *Sim_UCB0CTLW0_Ref(void)
+{
+    //Polled in busy loops (UCTXSTT), every access costs a few cycles so those loops make progress
+    Cycle += REG_POLL_CYCLES;
+    Sim_Update();
+    return &Sim_UCB0CTLW0;
+}
+
+//----------------------------------------------------------------------------------------------------
+volatile uint16_t *Sim_TB0R_Ref(void)
+{
+    Cycle++;
+    Timer_Update(&Timer0);
+    return &TB0R_Val;
+}
+
+//----------------------------------------------------------------------------------------------------
+volatile uint16_t *Sim_TB1R_Ref(void)
+{
+    Cycle++;
+    Timer_Update(&Timer1);
+    return &TB1R_Val;
+}
+
+//----------------------------------------------------------------------------------------------------
+uint16_t Sim_UCB0IV_Read(void)
+{   return Bus_IV();    }
+
+//----------------------------------------------------------------------------------------------------
+uint16_t Sim_UCA0IV_Read(void)
+{   return USCI_NONE;   }
+
+//----------------------------------------------------------------------------------------------------
+uint16_t Sim_TB0IV_Read(void)
+{   return Timer_IV(&Timer0);   }
+
+//----------------------------------------------------------------------------------------------------
+uint16_t Sim_TB1IV_Read(void)
+{   return Timer_IV(&Timer1);   }
+
+//----------------------------------------------------------------------------------------------------
+// Intrinsics
+//----------------------------------------------------------------------------------------------------
+void __bis_SR_register(unsigned int bits)
+{
+    if(bits & GIE)
+    {   GIE_On = true;  }
+    if(bits & CPUOFF)
+    {   WakeReq = false;
+        Sim_RunUntil(UINT64_MAX, true);     }
+    else if(GIE_On)
+    {   Sim_Dispatch();     }
+}
+
+//----------------------------------------------------------------------------------------------------
+void __bic_SR_register(unsigned int bits)
+{
+    if(bits & GIE)
+    {   GIE_On = false;     }
+}
+
+//----------------------------------------------------------------------------------------------------
+void __bis_SR_register_on_exit(unsigned int bits)
+{   (void)bits;     }
+
+//----------------------------------------------------------------------------------------------------
+void __bic_SR_register_on_exit(unsigned int bits)
+{
+    if(bits & CPUOFF)
+    {   WakeReq = true;     }
+}
+
+//----------------------------------------------------------------------------------------------------
+unsigned int __get_SR_register(void)
+{   return GIE_On ? GIE : 0;    }
+
+//----------------------------------------------------------------------------------------------------
+unsigned short __get_interrupt_state(void)
+{   return GIE_On ? GIE : 0;    }
+
+//----------------------------------------------------------------------------------------------------
+void __set_interrupt_state(unsigned short state)
+{
+    GIE_On = (state & GIE)!=0;
+    if(GIE_On)
+    {   Sim_Dispatch();     }
+}
+
+//----------------------------------------------------------------------------------------------------
+void __enable_interrupt(void)
+{
+    GIE_On = true;
+    Sim_Dispatch();
+}
+
+//----------------------------------------------------------------------------------------------------
+void __disable_interrupt(void)
+{   GIE_On = false;     }
+
+//----------------------------------------------------------------------------------------------------
+void __no_operation(void)
+{
+}
+
+//----------------------------------------------------------------------------------------------------
+void __delay_cycles(unsigned long cycles)
+{   Sim_RunUntil(Cycle+cycles, false);      }
+
+#endif
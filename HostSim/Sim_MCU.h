@@ -0,0 +1,75 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Sim_MCU.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Host simulator for the MSP430FR2155 peripherals the firmware uses: the clock, Timer0_B3 and
+ * Timer1_B3, port 1/2 pin interrupts and eUSCI_B0 as an I2C master, plus the interrupt dispatch
+ * that ties them to the ISRs in the firmware. Devices on the I2C bus and anything else that needs
+ * to run on simulated time plug in through the interfaces below.
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef SIM_MCU_H
+#define SIM_MCU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define SIM_MCLK_HZ             8000000ULL          //Fixed, the firmware sets this up first thing
+#define SIM_ACLK_HZ             32768ULL
+#define SIM_CYCLES_PER_MS       (SIM_MCLK_HZ/1000)
+
+//----------------------------------------------------------------------------------------------------
+// Device on the simulated I2C bus. Start is called when its address goes out (also after a
+// repeated start) and returns the address ACK, Write returns the ACK for each byte written by the
+// master.
+typedef struct SimI2CDev_s
+{
+    uint8_t Addr;
+    bool (*Start)(struct SimI2CDev_s *dev, bool read);
+    bool (*Write)(struct SimI2CDev_s *dev, uint8_t data);
+    uint8_t (*Read)(struct SimI2CDev_s *dev);
+    void (*Stop)(struct SimI2CDev_s *dev);
+    struct SimI2CDev_s *Next;
+} SimI2CDev_t;
+
+//----------------------------------------------------------------------------------------------------
+// Something that runs on simulated time (e.g. the AFE conversion cycle). Run is called once the
+// simulated clock reaches Due and must move Due forward.
+typedef struct SimTask_s
+{
+    uint64_t Due;
+    void (*Run)(struct SimTask_s *task);
+    struct SimTask_s *Next;
+} SimTask_t;
+
+//----------------------------------------------------------------------------------------------------
+// Counters kept by the simulator, printed by Sim_Report()
+typedef struct
+{
+    unsigned long ISR_CT[4];                        //Timer0_B1, Timer1_B1, USCI_B0, Port 1
+    unsigned long I2C_Start_CT;
+    unsigned long I2C_Byte_CT;
+    unsigned long I2C_NACK_CT;
+    uint64_t Sleep_Cycles;
+} SimStats_t;
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void Sim_MCU_Reset(void);
+void Sim_Set_EndCycle(uint64_t cycle);
+uint64_t Sim_Now(void);
+void Sim_I2C_Attach(SimI2CDev_t *dev);
+void Sim_Add_Task(SimTask_t *task);
+void Sim_Set_Pin(uint8_t port, uint8_t bit, bool level);
+void Sim_Report(void);
+void Sim_Log_For(uint64_t cycles);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern SimStats_t Sim_Stats;
+extern void (*Sim_OnEnd)(void);
+
+#endif
@@ -0,0 +1,349 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Sim_Main.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Host simulator entry point: sets up the simulated board, runs the unmodified firmware main()
+ * (built as BMS_main) for the requested amount of simulated time and reports on it
+----------------------------------------------------------------------------------------------------*/
+#ifdef BMS_HOST_SIM
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "msp430.h"
+#include "Constants.h"
+#include "I2C_Handler.h"
+#include "SOC_Handler.h"
+#include "BatteryData.h"
+#include "CC_Offset.h"
+#include "SOH_Handler.h"
+#include "History_Handler.h"
+#include "Fault_Log.h"
+#include "Latency_Handler.h"
+#include "Sim_MCU.h"
+#include "Sim_BQ769x0.h"
+#include "Sim_NTP5312.h"
+#include "Persistent.h"
+
+//----------------------------------------------------------------------------------------------------
+// Usage: bms_sim [-t seconds] [-i current_mA] [-p seconds] [-s soc_permille] [-d soc_permille]
+//                [-r input] [-o cc_counts] [-c temp_C] [-e mV] [-n read] [-v] [-T] [-L] [-q]
+//   -t  simulated run time, default 60s
+//   -i  charger (+) or load (-) current demand, default 0
+//   -p  pulse the -i demand, on and off for this long each, default steady
+//   -s  starting state of charge of every cell in 0.1%, default 500
+//   -d  imbalance, each AFE input starts this much (0.1%) above the one below it, default 0
+//   -r  AFE input (0 based) whose cell has double the internal resistance, default none
+//   -o  coulomb counter offset of the AFE model in CC counts, default 0
+//   -c  temperature at all thermistors, default 25C
+//   -e  open circuit voltage of an empty cell, default 3000mV, below the AFE's UV trip (~2480mV)
+//       lets a discharge run into UV
+//   -n  from this NFC configuration read on (1 is the one at startup, then one a second) draw 4.0A,
+//       over BCPD and under the AFE's OCD. The conversion that trips BCPD is held back until 100uS
+//       into the first chunk of the next read, on a board the AFE and Timer0_B clocks drift into
+//       that phase on their own. Logs the bus around it, fails unless the FET write makes it out
+//       before the second chunk.
+//   -v  print the pack and firmware state once a second
+//   -T  drain the I2C bus trace every 20mS (build with TRACE=1), pipe into trace_decode
+//   -L  dump the fault log and latency stats at the end of the run, pipe into flog_decode
+//   -q  only print the summary line
+
+//----------------------------------------------------------------------------------------------------
+// Firmware state reported at the end of the run
+extern int BMS_main(void);
+extern signed int IMeasured;
+extern unsigned int Cell_VMax;
+extern unsigned int Cell_VMin;
+extern uint8_t FETBits;
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+static clock_t WallStart;
+static bool Quiet = false;
+static bool DumpLog = false;
+static SimTask_t TraceTask;
+static SimTask_t LoadTask;
+static int32_t LoadCurrent_mA = 0;
+static uint32_t LoadPeriod_ms = 0;
+static const uint8_t CellPos[PACK_NUM_CELLS] = PACK_CELL_POSITIONS;
+#ifdef I2C_TRACE_ENABLE
+static SimTask_t DumpTask;
+#endif
+static bool Failed = false;
+
+//Overload during an NFC read (-n): the read it starts at, reads seen so far, the task watching the
+//BCPD qualifier, whether the tripping conversion is held, when it went in and the SYS_CTRL2 write
+//count then, and the time from it to the FET write if that beat the second chunk (0 if not)
+#define OVERLOAD_mA             -4000
+static long OverloadRead = 0;
+static long NFCReads = 0;
+static SimTask_t OverloadTask;
+static bool TripHeld = false;
+static long TripRead = 0;
+static uint64_t TripCycle = 0;
+static uint32_t TripCtrl2 = 0;
+static uint64_t TripFET = 0;
+
+//----------------------------------------------------------------------------------------------------
+// Highest minus lowest cell of the model, shorted inputs left out
+static uint16_t Sim_Spread_mV(void)
+{
+    uint16_t Max = 0;
+    uint16_t Min = 0xFFFF;
+    uint16_t mV;
+    uint8_t CT;
+
+    for(CT=0; CT<Sim_Pack.Positions; CT++)
+    {
+        if(Sim_Pack.ShortedMask & (1<<CT))
+        {   continue;   }
+        mV = Sim_BQ_Get_Cell_mV(CT);
+        Max = (mV>Max) ? mV : Max;
+        Min = (mV<Min) ? mV : Min;
+    }
+    return Max-Min;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Pulsed load, toggles the demand between the -i current and 0
+static void Sim_Load(SimTask_t *task)
+{
+    Sim_Pack.Request_mA = Sim_Pack.Request_mA ? 0 : LoadCurrent_mA;
+    task->Due += LoadPeriod_ms*SIM_CYCLES_PER_MS;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Every mS while the overload is on, holds the AFE's conversions once the next one trips BCPD
+static void Sim_Overload(SimTask_t *task)
+{
+    if(!TripHeld && !TripCycle && BCPD_Latch.QualedSample_CT+1>=BCPD_Latch.QualedSample_LIM)
+    {   Sim_BQ_Convert_At(UINT64_MAX);
+        TripHeld = true;                }
+    task->Due += SIM_CYCLES_PER_MS;
+}
+
+//----------------------------------------------------------------------------------------------------
+// NFC read starting, addr is the byte address of the chunk
+static void Sim_NFCRead(uint16_t addr)
+{
+    uint16_t First = NFC_CFG_BLOCK*SIM_NTP_BLOCKLEN;
+
+    if(addr==First && ++NFCReads==OverloadRead)
+    {   Sim_Pack.Request_mA = OVERLOAD_mA;
+        OverloadTask.Due = Sim_Now() + SIM_CYCLES_PER_MS;
+        OverloadTask.Run = Sim_Overload;
+        Sim_Add_Task(&OverloadTask);                        }
+    else if(addr==First && TripHeld)
+    {   TripHeld = false;
+        TripRead = NFCReads;
+        TripCycle = Sim_Now() + SIM_CYCLES_PER_MS/10;
+        TripCtrl2 = Sim_Pack.Ctrl2Write_CT;
+        Sim_BQ_Convert_At(TripCycle);
+        Sim_Log_For(10*SIM_CYCLES_PER_MS);
+        printf("%10.3f ms  conversion that trips BCPD due\n", (double)TripCycle*1000/SIM_MCLK_HZ);  }
+    else if(addr==First+I2C_NTP5312CHUNK && NFCReads==TripRead && !TripFET &&
+            Sim_Pack.Ctrl2Write_CT!=TripCtrl2)
+    {   TripFET = Sim_Pack.Ctrl2Write_Cycle - TripCycle;    }
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Sim_Summary(void)
+{
+    double Wall = (double)(clock()-WallStart)/CLOCKS_PER_SEC;
+    double SimTime = (double)Sim_Now()/SIM_MCLK_HZ;
+    LatStats_t Lat = Latency_Stage[LAT_ALERT_FET];      //Latency_Report starts the stats over
+    uint16_t Lat_Over = Latency_Over_CT;
+    uint16_t Lat_Missed = Latency_Missed_CT;
+    uint8_t CT;
+
+    if(DumpLog)
+    {   FaultLog_Dump();
+        Latency_Report();   }
+    if(!Quiet)
+    {
+        Sim_Report();
+        printf("AFE cycles        %lu\n", Sim_Stats.ISR_CT[3]);
+        printf("AFE SYS_STAT      0x%02X, SYS_CTRL2 0x%02X\n", Sim_BQ_Get_Reg(REG_SYS_STAT),
+               Sim_BQ_Get_Reg(REG_SYS_CTRL2));
+        printf("firmware          IMeasured %d, VMax %u, VMin %u, FETBits 0x%02X\n", IMeasured,
+               Cell_VMax, Cell_VMin, FETBits);
+#ifdef I2C_BENCH
+        printf("I2C bench         2/10/32 byte reads %u/%u/%u us, %u/%u/%u interrupts\n",
+               I2C_BenchTicks[0], I2C_BenchTicks[1], I2C_BenchTicks[2], I2C_BenchISRs[0],
+               I2C_BenchISRs[1], I2C_BenchISRs[2]);
+#endif
+        printf("I2C handler       %u recoveries, max queue wait PROT %u BULK %u ticks\n",
+               I2C_Recover_CT, I2C_MaxQueueTicks[I2C_PRIO_PROT], I2C_MaxQueueTicks[I2C_PRIO_BULK]);
+        printf("NFC               %u configuration reads\n", NFC_Read_CT);
+        printf("pack              cell 1 %u mV, %d mA\n", Sim_BQ_Get_Cell_mV(0),
+               (int)Sim_BQ_Get_Current_mA());
+        printf("SOC               %u.%u %%, %u mAh (model cell 1 %.1f %%)\n", SOC_Get_Permille()/10,
+               SOC_Get_Permille()%10, SOC_Get_mAh(),
+               Sim_Pack.Charge_uAh[0]/(10.0*Sim_Pack.Capacity_mAh));
+        printf("temperature       TS1 %.1f C (model %.1f C)\n", Get_Temp_dC(0)/10.0,
+               Sim_Pack.Temp_dC[0]/10.0);
+        printf("balancing         CB 0x%04X, model spread %u mV, %lu adjacent\n", Sim_BQ_Get_CB(),
+               Sim_Spread_mV(), (unsigned long)Sim_Pack.BalAdjacent_CT);
+        printf("cell IR mOhm     ");
+        for(CT=0; CT<PACK_NUM_CELLS; CT++)
+        {   printf(" %4.1f", SOH_Get_IR_uOhm(CT)/1000.0);  }
+        printf(" (%u steps, weak 0x%04X)\n                  ", SOH_Store.Steps, SOH_Get_WeakCells());
+        for(CT=0; CT<PACK_NUM_CELLS; CT++)
+        {   printf(" %4u", Sim_Pack.RCell_mOhm[CellPos[CT]]);    }
+        printf(" (model)\n");
+        printf("history           %lu snapshots, last minute cell 1 %u mV %d CC, this hour cell 1 "
+               "%u-%u mV\n", (unsigned long)History_Store.Cycles,
+               History_Store.Minute[(History_Store.Min_Idx+HIST_MIN_LEN-1)%HIST_MIN_LEN].Cell_mV[0],
+               History_Store.Minute[(History_Store.Min_Idx+HIST_MIN_LEN-1)%HIST_MIN_LEN].CC,
+               History_Store.Hour[History_Store.Hour_Idx].Min_mV[0],
+               History_Store.Hour[History_Store.Hour_Idx].Max_mV[0]);
+        printf("CC offset         %d counts (model %d), calibrated bins 0x%02X\n", CCOffset_Get(),
+               Sim_Pack.CCOffset, CCOffset_Store.ValidMask);
+        printf("fault log         %u events, %u dropped, %lu ticks\n", FaultLog_Store.Count,
+               FaultLog_Store.Dropped, (unsigned long)FaultLog_Store.Tick);
+        printf("ALERT to FET      %u cycles, %u-%u us, avg %u us, %u over %u us, %u not timed\n",
+               Lat.Num, Lat.Num ? Lat.Min : 0, Lat.Num ? Lat.Max : 0,
+               Lat.Num ? (unsigned int)(Lat.Sum/Lat.Num) : 0, Lat_Over, LAT_BOUND_TICKS, Lat_Missed);
+    }
+    printf("simulated %.1f s in %.3f s wall (%.0fx real time, %.1f Mcycles/s)\n", SimTime, Wall,
+           Wall>0 ? SimTime/Wall : 0.0, Wall>0 ? Sim_Now()/Wall/1e6 : 0.0);
+
+    if(Sim_Pack.Reclose_CT)
+    {   printf("FAIL: %lu SYS_CTRL2 writes turned a FET back on into the OV or UV that opened it\n",
+               (unsigned long)Sim_Pack.Reclose_CT);
+        Failed = true;                                                                      }
+    if(OverloadRead)
+    {   if(TripFET)
+        {   printf("BCPD trip in NFC read %ld: FET write %.0f us after the conversion, between its "
+                   "chunks, max PROT queue wait %u us\n", TripRead, (double)TripFET*1e6/SIM_MCLK_HZ,
+                   I2C_MaxQueueTicks[I2C_PRIO_PROT]);    }
+        else
+        {   printf("FAIL: overload from NFC read %ld: no FET write between the chunks of a read\n",
+                   OverloadRead);
+            Failed = true;                                                                  }   }
+    if(Failed)
+    {   exit(1);    }
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Sim_Trace(SimTask_t *task)
+{
+    printf("%7.2f s  I %6d mA  cell1 %4u mV  STAT 0x%02X CTRL2 0x%02X | IMeas %6d VMax %5u VMin %5u "
+           "FET 0x%02X\n", (double)Sim_Now()/SIM_MCLK_HZ, (int)Sim_BQ_Get_Current_mA(),
+           Sim_BQ_Get_Cell_mV(0), Sim_BQ_Get_Reg(REG_SYS_STAT), Sim_BQ_Get_Reg(REG_SYS_CTRL2),
+           IMeasured, Cell_VMax, Cell_VMin, FETBits);
+    task->Due += 1000*SIM_CYCLES_PER_MS;
+}
+
+#ifdef I2C_TRACE_ENABLE
+//----------------------------------------------------------------------------------------------------
+// Pull the bus trace out the way a debugger would, often enough that the ring never overflows
+static void Sim_Dump(SimTask_t *task)
+{
+    I2C_Trace_Dump();
+    task->Due += 20*SIM_CYCLES_PER_MS;
+}
+
+//----------------------------------------------------------------------------------------------------
+// The UART is not simulated, trace dumps from the firmware go straight to stdout
+void Init_UART(void)
+{
+}
+#endif
+
+//------------------------------------------------------//--------------------------------------------
+int main(int argc, char **argv)
+{
+    double RunTime = 60.0;
+    long Current = 0;
+    long SOC = 500;
+    long Spread = 0;
+    long Offset = 0;
+    long Weak = -1;
+    long Empty_mV = 0;
+    double Pulse = 0.0;
+    double Temp = 25.0;
+    uint8_t CT;
+    int Arg;
+
+    for(Arg=1; Arg<argc; Arg++)
+    {
+        if(!strcmp(argv[Arg], "-t") && Arg+1<argc)
+        {   RunTime = atof(argv[++Arg]);    }
+        else if(!strcmp(argv[Arg], "-i") && Arg+1<argc)
+        {   Current = atol(argv[++Arg]);    }
+        else if(!strcmp(argv[Arg], "-s") && Arg+1<argc)
+        {   SOC = atol(argv[++Arg]);    }
+        else if(!strcmp(argv[Arg], "-p") && Arg+1<argc)
+        {   Pulse = atof(argv[++Arg]);      }
+        else if(!strcmp(argv[Arg], "-r") && Arg+1<argc)
+        {   Weak = atol(argv[++Arg]);       }
+        else if(!strcmp(argv[Arg], "-d") && Arg+1<argc)
+        {   Spread = atol(argv[++Arg]);     }
+        else if(!strcmp(argv[Arg], "-o") && Arg+1<argc)
+        {   Offset = atol(argv[++Arg]);     }
+        else if(!strcmp(argv[Arg], "-c") && Arg+1<argc)
+        {   Temp = atof(argv[++Arg]);       }
+        else if(!strcmp(argv[Arg], "-e") && Arg+1<argc)
+        {   Empty_mV = atol(argv[++Arg]);   }
+        else if(!strcmp(argv[Arg], "-n") && Arg+1<argc)
+        {   OverloadRead = atol(argv[++Arg]);   }
+        else if(!strcmp(argv[Arg], "-v"))
+        {   TraceTask.Due = 1000*SIM_CYCLES_PER_MS;
+            TraceTask.Run = Sim_Trace;          }
+#ifdef I2C_TRACE_ENABLE
+        else if(!strcmp(argv[Arg], "-T"))
+        {   DumpTask.Due = 20*SIM_CYCLES_PER_MS;
+            DumpTask.Run = Sim_Dump;            }
+#endif
+        else if(!strcmp(argv[Arg], "-L"))
+        {   DumpLog = true; }
+        else if(!strcmp(argv[Arg], "-q"))
+        {   Quiet = true;   }
+        else
+        {   fprintf(stderr, "usage: %s [-t seconds] [-i current_mA] [-p seconds] [-s soc_permille] "
+                    "[-d soc_permille] [-r input] [-o cc_counts] [-c temp_C] [-e mV] [-n read] [-v] "
+                    "[-T] [-L] [-q]\n",
+                    argv[0]);
+            return 1;                                                                       }
+    }
+
+    Sim_MCU_Reset();
+    Sim_BQ_Init();
+    Sim_NTP_Init();
+    Sim_NTP_OnRead = Sim_NFCRead;
+    if(TraceTask.Run)
+    {   Sim_Add_Task(&TraceTask);   }
+#ifdef I2C_TRACE_ENABLE
+    if(DumpTask.Run)
+    {   Sim_Add_Task(&DumpTask);    }
+#endif
+    Sim_Pack.Request_mA = Current;
+    Sim_Pack.CCOffset = Offset;
+    for(CT=0; CT<SIM_BQ_NUMTS; CT++)
+    {   Sim_Pack.Temp_dC[CT] = Temp*10;     }
+    if(Empty_mV>0)
+    {   Sim_Pack.OCV_mV[0] = Empty_mV;  }
+    for(CT=0; CT<SIM_BQ_POSITIONS; CT++)
+    {   Sim_BQ_Set_SOC(CT, SOC+CT*Spread);  }
+    if(Weak>=0 && Weak<SIM_BQ_POSITIONS)
+    {   Sim_Pack.RCell_mOhm[Weak] *= 2;     }
+    if(Pulse>0.0)
+    {   LoadCurrent_mA = Current;
+        LoadPeriod_ms = Pulse*1000;
+        LoadTask.Due = LoadPeriod_ms*SIM_CYCLES_PER_MS;
+        LoadTask.Run = Sim_Load;
+        Sim_Add_Task(&LoadTask);                        }
+
+    Sim_Set_EndCycle((uint64_t)(RunTime*SIM_MCLK_HZ));
+    Sim_OnEnd = Sim_Summary;
+    WallStart = clock();
+
+    return BMS_main();
+}
+
+#endif
@@ -0,0 +1,100 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Sim_NTP5312.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Memory stand-in for the NTP5312 NFC tag on the simulated I2C bus
+----------------------------------------------------------------------------------------------------*/
+#ifdef BMS_HOST_SIM
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include "msp430.h"
+#include "Constants.h"
+#include "Sim_MCU.h"
+#include "Sim_NTP5312.h"
+
+//----------------------------------------------------------------------------------------------------
+// The first two bytes of a write are the block address (MSB first), data follows and reads carry on
+// from there, auto-incrementing across block boundaries. Memory starts out holding the low byte of
+// each byte's own address so a misplaced chunk shows up in the data.
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+void (*Sim_NTP_OnRead)(uint16_t addr) = 0;          //Called as a read starts, byte address
+
+static uint8_t Mem[SIM_NTP_BLOCKS*SIM_NTP_BLOCKLEN];
+static uint16_t Ptr = 0;
+static uint8_t AddrBytes = 0;
+static SimI2CDev_t NTPDev;
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static bool NTP_Start(SimI2CDev_t *dev, bool read);
+static bool NTP_Write(SimI2CDev_t *dev, uint8_t data);
+static uint8_t NTP_Read(SimI2CDev_t *dev);
+static void NTP_Stop(SimI2CDev_t *dev);
+
+//------------------------------------------------------//--------------------------------------------
+void Sim_NTP_Init(void)
+{
+    uint16_t CT;
+
+    for(CT=0; CT<sizeof(Mem); CT++)
+    {   Mem[CT] = CT & 0xFF;    }
+
+    NTPDev.Addr = I2C_NTP5312ADDR;
+    NTPDev.Start = NTP_Start;
+    NTPDev.Write = NTP_Write;
+    NTPDev.Read = NTP_Read;
+    NTPDev.Stop = NTP_Stop;
+    Sim_I2C_Attach(&NTPDev);
+}
+
+//----------------------------------------------------------------------------------------------------
+uint8_t Sim_NTP_Get_Byte(uint16_t addr)
+{   return Mem[addr % sizeof(Mem)];     }
+
+//----------------------------------------------------------------------------------------------------
+static bool NTP_Start(SimI2CDev_t *dev, bool read)
+{
+    (void)dev;
+    AddrBytes = read ? 2 : 0;
+    if(read && Sim_NTP_OnRead)
+    {   Sim_NTP_OnRead(Ptr);    }
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------
+static bool NTP_Write(SimI2CDev_t *dev, uint8_t data)
+{
+    (void)dev;
+    if(AddrBytes==0)
+    {   Ptr = (uint16_t)data << 8;
+        AddrBytes++;
+        return true;                }
+    if(AddrBytes==1)
+    {   Ptr = ((Ptr | data) * SIM_NTP_BLOCKLEN) % sizeof(Mem);
+        AddrBytes++;
+        return true;                }
+
+    Mem[Ptr] = data;
+    Ptr = (Ptr+1) % sizeof(Mem);
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------
+static uint8_t NTP_Read(SimI2CDev_t *dev)
+{
+    uint8_t Data = Mem[Ptr];
+
+    (void)dev;
+    Ptr = (Ptr+1) % sizeof(Mem);
+    return Data;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void NTP_Stop(SimI2CDev_t *dev)
+{   (void)dev;  }
+
+#endif
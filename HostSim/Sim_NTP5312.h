@@ -0,0 +1,28 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Sim_NTP5312.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Memory stand-in for the NTP5312 NFC tag on the simulated I2C bus
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef SIM_NTP5312_H
+#define SIM_NTP5312_H
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define SIM_NTP_BLOCKS          512
+#define SIM_NTP_BLOCKLEN        4                   //Bytes per block, the address counts blocks
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void Sim_NTP_Init(void);
+uint8_t Sim_NTP_Get_Byte(uint16_t addr);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern void (*Sim_NTP_OnRead)(uint16_t addr);
+
+#endif
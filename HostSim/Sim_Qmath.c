@@ -0,0 +1,33 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Sim_Qmath.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Host versions of the QmathLib routines the firmware links against, the shipped library is
+ * MSP430 object code only
+----------------------------------------------------------------------------------------------------*/
+#ifdef BMS_HOST_SIM
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <stdlib.h>
+#include "QmathLib.h"
+
+//----------------------------------------------------------------------------------------------------
+// String to Q8, saturating like the library does
+_q8 _atoQ8(const char *A)
+{
+    double Val = atof(A) * 256.0;
+
+    if(Val>32767.0)
+    {   return 32767;   }
+    if(Val<-32768.0)
+    {   return -32768;  }
+    return (_q8)Val;
+}
+
+//----------------------------------------------------------------------------------------------------
+_q15 _Q15mpy(_q15 A, _q15 B)
+{   return (_q15)(((int32_t)A * B) >> 15);  }
+
+#endif
@@ -0,0 +1,213 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Trace_Decode.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Host tool that reads I2C bus trace dumps (I2C_Trace_Dump() output captured from the UART or from
+ * bms_sim -T) on stdin and prints per transfer latency statistics and histograms
+----------------------------------------------------------------------------------------------------*/
+#ifdef BMS_HOST_SIM
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------------------------------
+// Transfers are told apart by device, first register, direction and data byte count, latency is
+// START to DONE in Timer1_B ticks (1uS). Anything else on the input is ignored, so a raw UART log
+// can be fed in as is. A dump that reports overwritten events drops the transfer in progress.
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define MAX_KEYS                64
+#define NUM_BINS                9                   //<64uS, then doubling up to >=8192uS
+#define FIRST_BIN_US            64
+#define BAR_WIDTH               40
+
+//Must match I2CTraceEvt_t in I2C_Handler.h
+enum {I2CTR_START, I2CTR_REG, I2CTR_COUNT, I2CTR_RESTART, I2CTR_NACK, I2CTR_STOP, I2CTR_DONE};
+
+typedef struct
+{
+    uint8_t Addr;
+    int Reg;
+    bool Read;
+    unsigned int Bytes;
+    unsigned long Num;
+    unsigned long NACK_CT;
+    unsigned long Error_CT;
+    unsigned int Min;
+    unsigned int Max;
+    unsigned long long Sum;
+    unsigned long Hist[NUM_BINS];
+} TraceKey_t;
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+static TraceKey_t Keys[MAX_KEYS];
+static unsigned int NumKeys = 0;
+static unsigned long Total_CT = 0;
+static unsigned long Lost_CT = 0;
+static unsigned long Orphan_CT = 0;
+
+//----------------------------------------------------------------------------------------------------
+static TraceKey_t *Find_Key(uint8_t addr, int reg, bool read, unsigned int bytes)
+{
+    unsigned int CT;
+
+    for(CT=0; CT<NumKeys; CT++)
+    {   if(Keys[CT].Addr==addr && Keys[CT].Reg==reg && Keys[CT].Read==read && Keys[CT].Bytes==bytes)
+        {   return &Keys[CT];   }                                                                   }
+    if(NumKeys==MAX_KEYS)
+    {   return 0;   }
+
+    memset(&Keys[NumKeys], 0, sizeof(TraceKey_t));
+    Keys[NumKeys].Addr = addr;
+    Keys[NumKeys].Reg = reg;
+    Keys[NumKeys].Read = read;
+    Keys[NumKeys].Bytes = bytes;
+    Keys[NumKeys].Min = 0xFFFF;
+    return &Keys[NumKeys++];
+}
+
+//----------------------------------------------------------------------------------------------------
+static unsigned int Bin_Of(unsigned int us)
+{
+    unsigned int Bin = 0;
+    unsigned int Limit = FIRST_BIN_US;
+
+    while(Bin<NUM_BINS-1 && us>=Limit)
+    {   Bin++;
+        Limit <<= 1;    }
+    return Bin;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Print_Report(void)
+{
+    unsigned long Peak;
+    unsigned int Limit;
+    unsigned int CT;
+    unsigned int Bin;
+    TraceKey_t *Key;
+
+    printf("%lu transfers in %u groups, %lu events overwritten, %lu incomplete transfers dropped\n",
+           Total_CT, NumKeys, Lost_CT, Orphan_CT);
+    for(CT=0; CT<NumKeys; CT++)
+    {
+        Key = &Keys[CT];
+        printf("\naddr 0x%02X reg 0x%02X %-5s %3u bytes: %lu transfers, %lu NACK, %lu failed\n",
+               Key->Addr, Key->Reg<0 ? 0 : Key->Reg, Key->Read ? "read" : "write", Key->Bytes,
+               Key->Num, Key->NACK_CT, Key->Error_CT);
+        if(!Key->Num)
+        {   continue;   }
+        printf("  latency uS  min %u  avg %.1f  max %u\n", Key->Min, (double)Key->Sum/Key->Num,
+               Key->Max);
+
+        Peak = 1;
+        for(Bin=0; Bin<NUM_BINS; Bin++)
+        {   if(Key->Hist[Bin]>Peak)
+            {   Peak = Key->Hist[Bin];  }       }
+        Limit = FIRST_BIN_US;
+        for(Bin=0; Bin<NUM_BINS; Bin++, Limit<<=1)
+        {
+            if(Bin<NUM_BINS-1)
+            {   printf("  <%6u ", Limit);  }
+            else
+            {   printf("  >=%5u ", Limit>>1);  }
+            printf("%8lu |%.*s\n", Key->Hist[Bin], (int)(Key->Hist[Bin]*BAR_WIDTH/Peak),
+                   "########################################");
+        }
+    }
+}
+
+//------------------------------------------------------//--------------------------------------------
+int main(void)
+{
+    char Line[128];
+    unsigned int Time;
+    unsigned int Event;
+    unsigned int Data;
+    unsigned int Num;
+    unsigned int Lost;
+    bool Open = false;
+    bool NACK = false;
+    bool Read = false;
+    uint16_t Start = 0;
+    uint8_t Addr = 0;
+    int Reg = -1;
+    unsigned int Bytes = 0;
+    unsigned int Lat;
+    unsigned int Bin;
+    TraceKey_t *Key;
+
+    while(fgets(Line, sizeof(Line), stdin))
+    {
+        if(sscanf(Line, " I2CT BEGIN %u %u", &Num, &Lost)==2)
+        {   Lost_CT += Lost;
+            if(Lost && Open)
+            {   Orphan_CT++;
+                Open = false;   }
+            continue;               }
+        if(sscanf(Line, " I2CT %u %u %u", &Time, &Event, &Data)!=3)
+        {   continue;   }
+
+        switch(Event)
+        {
+            case I2CTR_START:
+                if(Open)
+                {   Orphan_CT++;    }
+                Open = true;
+                NACK = false;
+                Read = false;
+                Start = Time;
+                Addr = Data;
+                Reg = -1;
+                Bytes = 0;
+                break;
+            case I2CTR_REG:
+                if(Reg<0)
+                {   Reg = Data;     }
+                break;
+            case I2CTR_COUNT:
+                Bytes = Data;
+                break;
+            case I2CTR_RESTART:
+                Read = true;
+                break;
+            case I2CTR_NACK:
+                NACK = true;
+                break;
+            case I2CTR_DONE:
+                if(!Open)
+                {   break;  }
+                Open = false;
+                Key = Find_Key(Addr, Reg, Read, Bytes);
+                if(!Key)
+                {   break;  }
+                Lat = (uint16_t)(Time - Start);
+                Key->Num++;
+                Key->NACK_CT += NACK;
+                Key->Error_CT += (Data!=1);         //I2C_OK
+                Key->Sum += Lat;
+                if(Lat<Key->Min)
+                {   Key->Min = Lat;     }
+                if(Lat>Key->Max)
+                {   Key->Max = Lat;     }
+                Bin = Bin_Of(Lat);
+                Key->Hist[Bin]++;
+                Total_CT++;
+                break;
+            default:
+                break;
+        }
+    }
+
+    Print_Report();
+    return 0;
+}
+
+#endif
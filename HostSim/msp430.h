@@ -0,0 +1,269 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: msp430.h (HostSim)
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Stand-in for the TI device header when the firmware is built for the host simulator. This is
+ * the hardware abstraction layer of the simulator: every peripheral register the firmware touches
+ * is a plain variable owned by Sim_MCU.c, the few registers with side effects on access (interrupt
+ * vector registers, timer counters and the eUSCI_B0 control word that gets polled) go through
+ * Sim_MCU functions, and the intrinsics drive the simulated clock and interrupt dispatch.
+ * Bit values match the MSP430FR2155 where the models depend on them.
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef SIM_MSP430_H
+#define SIM_MSP430_H
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------------------------------------
+// Compiler keywords
+#define __interrupt
+#define __even_in_range(val, range)     (val)
+
+//----------------------------------------------------------------------------------------------------
+// Bits
+#define BIT0                (0x0001)
+#define BIT1                (0x0002)
+#define BIT2                (0x0004)
+#define BIT3                (0x0008)
+#define BIT4                (0x0010)
+#define BIT5                (0x0020)
+#define BIT6                (0x0040)
+#define BIT7                (0x0080)
+#define BIT8                (0x0100)
+#define BIT9                (0x0200)
+#define BITA                (0x0400)
+#define BITB                (0x0800)
+#define BITC                (0x1000)
+#define BITD                (0x2000)
+#define BITE                (0x4000)
+#define BITF                (0x8000)
+
+//----------------------------------------------------------------------------------------------------
+// Status register
+#define GIE                 (0x0008)
+#define CPUOFF              (0x0010)
+#define OSCOFF              (0x0020)
+#define SCG0                (0x0040)
+#define SCG1                (0x0080)
+#define LPM0_bits           (CPUOFF)
+#define LPM3_bits           (SCG1+SCG0+CPUOFF)
+
+//----------------------------------------------------------------------------------------------------
+// Registers, defined in Sim_MCU.c
+#define SIM_REG8(name)      extern volatile uint8_t name;
+#define SIM_REG16(name)     extern volatile uint16_t name;
+
+SIM_REG8(P1IN)  SIM_REG8(P1OUT) SIM_REG8(P1DIR) SIM_REG8(P1REN) SIM_REG8(P1SEL0) SIM_REG8(P1SEL1)
+SIM_REG8(P1IES) SIM_REG8(P1IE)  SIM_REG8(P1IFG)
+SIM_REG8(P2IN)  SIM_REG8(P2OUT) SIM_REG8(P2DIR) SIM_REG8(P2REN) SIM_REG8(P2SEL0) SIM_REG8(P2SEL1)
+SIM_REG8(P2IES) SIM_REG8(P2IE)  SIM_REG8(P2IFG)
+SIM_REG8(P3IN)  SIM_REG8(P3OUT) SIM_REG8(P3DIR) SIM_REG8(P3REN) SIM_REG8(P3SEL0)
+SIM_REG8(P4IN)  SIM_REG8(P4OUT) SIM_REG8(P4DIR) SIM_REG8(P4REN) SIM_REG8(P4SEL0)
+
+SIM_REG16(PM5CTL0)  SIM_REG16(WDTCTL)   SIM_REG16(SYSCFG0)  SIM_REG16(FRCTL0)
+SIM_REG16(CSCTL0)   SIM_REG16(CSCTL1)   SIM_REG16(CSCTL2)   SIM_REG16(CSCTL3)
+SIM_REG16(CSCTL4)   SIM_REG16(CSCTL5)   SIM_REG16(CSCTL6)   SIM_REG16(CSCTL7)
+
+SIM_REG16(Sim_UCB0CTLW0) SIM_REG16(UCB0CTLW1) SIM_REG16(UCB0BRW)  SIM_REG16(UCB0STATW)
+SIM_REG16(UCB0TBCNT)     SIM_REG16(UCB0RXBUF) SIM_REG16(UCB0TXBUF) SIM_REG16(UCB0I2CSA)
+SIM_REG16(UCB0IE)        SIM_REG16(UCB0IFG)
+
+SIM_REG16(UCA0CTLW0) SIM_REG16(UCA0MCTLW) SIM_REG16(UCA0IE) SIM_REG16(UCA0IFG)
+SIM_REG16(UCA0RXBUF) SIM_REG16(UCA0TXBUF) SIM_REG8(UCA0BR0) SIM_REG8(UCA0BR1)
+
+SIM_REG16(TB0CTL)   SIM_REG16(TB0CCTL0) SIM_REG16(TB0CCTL1) SIM_REG16(TB0CCTL2)
+SIM_REG16(TB0CCR0)  SIM_REG16(TB0CCR1)  SIM_REG16(TB0CCR2)  SIM_REG16(TB0EX0)
+SIM_REG16(TB1CTL)   SIM_REG16(TB1CCTL0) SIM_REG16(TB1CCTL1) SIM_REG16(TB1CCTL2)
+SIM_REG16(TB1CCR0)  SIM_REG16(TB1CCR1)  SIM_REG16(TB1CCR2)  SIM_REG16(TB1EX0)
+
+//Registers with side effects on access
+volatile uint16_t *Sim_UCB0CTLW0_Ref(void);
+volatile uint16_t *Sim_TB0R_Ref(void);
+volatile uint16_t *Sim_TB1R_Ref(void);
+uint16_t Sim_UCB0IV_Read(void);
+uint16_t Sim_UCA0IV_Read(void);
+uint16_t Sim_TB0IV_Read(void);
+uint16_t Sim_TB1IV_Read(void);
+
+#define UCB0CTLW0           (*Sim_UCB0CTLW0_Ref())
+#define UCB0CTL1            (*(volatile uint8_t *)Sim_UCB0CTLW0_Ref())
+#define TB0R                (*Sim_TB0R_Ref())
+#define TB1R                (*Sim_TB1R_Ref())
+#define UCB0IV              (Sim_UCB0IV_Read())
+#define UCA0IV              (Sim_UCA0IV_Read())
+#define TB0IV               (Sim_TB0IV_Read())
+#define TB1IV               (Sim_TB1IV_Read())
+
+//----------------------------------------------------------------------------------------------------
+// PMM, WDT, FRAM
+#define LOCKLPM5            (0x0001)
+#define WDTPW               (0x5A00)
+#define WDTHOLD             (0x0080)
+#define FRCTLPW             (0xA500)
+#define NWAITS_0            (0x0000)
+#define NWAITS_1            (0x0010)
+#define FRWPPW              (0xA500)
+#define PFWP                (0x0001)
+#define DFWP                (0x0002)
+
+//----------------------------------------------------------------------------------------------------
+// Clock system
+#define DCOFTRIM0           (0x0010)
+#define DCOFTRIM            (0x0070)
+#define DCOFTRIMEN          (0x0080)
+#define DCORSEL_3           (0x0006)
+#define DCORSEL_7           (0x000E)
+#define FLLD_0              (0x0000)
+#define SELREF__REFOCLK     (0x0010)
+#define SELMS__DCOCLKDIV    (0x0000)
+#define SELA__REFOCLK       (0x0100)
+#define DIVM__1             (0x0000)
+#define DIVS__1             (0x0000)
+#define FLLUNLOCK0          (0x0100)
+#define FLLUNLOCK1          (0x0200)
+
+//----------------------------------------------------------------------------------------------------
+// eUSCI_B I2C
+#define UCSWRST             (0x0001)
+#define UCTXSTT             (0x0002)
+#define UCTXSTP             (0x0004)
+#define UCTXNACK            (0x0008)
+#define UCTR                (0x0010)
+#define UCTXACK             (0x0020)
+#define UCSSEL_1            (0x0040)
+#define UCSSEL_2            (0x0080)
+#define UCSSEL_3            (0x00C0)
+#define UCSSEL__ACLK        (0x0040)
+#define UCSSEL__SMCLK       (0x0080)
+#define UCSYNC              (0x0100)
+#define UCMODE_3            (0x0600)
+#define UCMST               (0x0800)
+
+#define UCASTP_0            (0x0000)
+#define UCASTP_1            (0x0004)
+#define UCASTP_2            (0x0008)
+#define UCASTP_3            (0x000C)
+#define UCCLTO0             (0x0040)
+#define UCCLTO1             (0x0080)
+#define UCCLTO_1            (0x0040)
+#define UCCLTO_2            (0x0080)
+#define UCCLTO_3            (0x00C0)
+
+#define UCBBUSY             (0x0010)
+
+#define UCRXIE0             (0x0001)
+#define UCTXIE0             (0x0002)
+#define UCRXIE              (UCRXIE0)
+#define UCTXIE              (UCTXIE0)
+#define UCSTTIE             (0x0004)
+#define UCSTPIE             (0x0008)
+#define UCALIE              (0x0010)
+#define UCNACKIE            (0x0020)
+#define UCBCNTIE            (0x0040)
+#define UCCLTOIE            (0x0080)
+
+#define UCRXIFG0            (0x0001)
+#define UCTXIFG0            (0x0002)
+#define UCRXIFG             (UCRXIFG0)
+#define UCTXIFG             (UCTXIFG0)
+#define UCSTTIFG            (0x0004)
+#define UCSTPIFG            (0x0008)
+#define UCALIFG             (0x0010)
+#define UCNACKIFG           (0x0020)
+#define UCBCNTIFG           (0x0040)
+#define UCCLTOIFG           (0x0080)
+
+#define USCI_NONE           (0x00)
+#define USCI_I2C_UCALIFG    (0x02)
+#define USCI_I2C_UCNACKIFG  (0x04)
+#define USCI_I2C_UCSTTIFG   (0x06)
+#define USCI_I2C_UCSTPIFG   (0x08)
+#define USCI_I2C_UCRXIFG3   (0x0A)
+#define USCI_I2C_UCTXIFG3   (0x0C)
+#define USCI_I2C_UCRXIFG2   (0x0E)
+#define USCI_I2C_UCTXIFG2   (0x10)
+#define USCI_I2C_UCRXIFG1   (0x12)
+#define USCI_I2C_UCTXIFG1   (0x14)
+#define USCI_I2C_UCRXIFG0   (0x16)
+#define USCI_I2C_UCTXIFG0   (0x18)
+#define USCI_I2C_UCBCNTIFG  (0x1A)
+#define USCI_I2C_UCCLTOIFG  (0x1C)
+#define USCI_I2C_UCBIT9IFG  (0x1E)
+
+#define USCI_UART_UCRXIFG   (0x02)
+#define USCI_UART_UCTXIFG   (0x04)
+#define USCI_UART_UCSTTIFG  (0x06)
+#define USCI_UART_UCTXCPTIFG (0x08)
+
+//----------------------------------------------------------------------------------------------------
+// Timer_B
+#define TBIFG               (0x0001)
+#define TBIE                (0x0002)
+#define TBCLR               (0x0004)
+#define MC_0                (0x0000)
+#define MC_1                (0x0010)
+#define MC_2                (0x0020)
+#define MC_3                (0x0030)
+#define MC__STOP            (MC_0)
+#define MC__UP              (MC_1)
+#define MC__CONTINUOUS      (MC_2)
+#define ID_0                (0x0000)
+#define ID_1                (0x0040)
+#define ID_2                (0x0080)
+#define ID_3                (0x00C0)
+#define TBSSEL_0            (0x0000)
+#define TBSSEL_1            (0x0100)
+#define TBSSEL_2            (0x0200)
+#define TBSSEL__ACLK        (TBSSEL_1)
+#define TBSSEL__SMCLK       (TBSSEL_2)
+
+#define CCIFG               (0x0001)
+#define COV                 (0x0002)
+#define CCIE                (0x0010)
+#define CAP                 (0x0100)
+#define SCS                 (0x0800)
+#define CCIS0               (0x1000)
+#define CCIS1               (0x2000)
+#define CCIS_2              (0x2000)
+#define CCIS_3              (0x3000)
+#define CM_1                (0x4000)
+#define CM_2                (0x8000)
+#define CM_3                (0xC000)
+
+#define TB0IV_NONE          (0x0000)
+#define TB0IV_TBCCR1        (0x0002)
+#define TB0IV_TBCCR2        (0x0004)
+#define TB0IV_TBIFG         (0x000E)
+#define TB1IV_NONE          (0x0000)
+#define TB1IV_TBCCR1        (0x0002)
+#define TB1IV_TBCCR2        (0x0004)
+#define TB1IV_TBIFG         (0x000E)
+
+//----------------------------------------------------------------------------------------------------
+// Interrupt vectors, only used by #pragma vector which the host compiler ignores
+#define PORT2_VECTOR        (1)
+#define PORT1_VECTOR        (2)
+#define USCI_B0_VECTOR      (3)
+#define USCI_A0_VECTOR      (4)
+#define TIMER1_B1_VECTOR    (5)
+#define TIMER1_B0_VECTOR    (6)
+#define TIMER0_B1_VECTOR    (7)
+#define TIMER0_B0_VECTOR    (8)
+
+//----------------------------------------------------------------------------------------------------
+// Intrinsics, implemented by Sim_MCU.c
+void __bis_SR_register(unsigned int bits);
+void __bic_SR_register(unsigned int bits);
+void __bis_SR_register_on_exit(unsigned int bits);
+void __bic_SR_register_on_exit(unsigned int bits);
+unsigned int __get_SR_register(void);
+unsigned short __get_interrupt_state(void);
+void __set_interrupt_state(unsigned short state);
+void __enable_interrupt(void);
+void __disable_interrupt(void);
+void __no_operation(void);
+void __delay_cycles(unsigned long cycles);
+
+#endif
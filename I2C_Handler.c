@@ -13,7 +13,28 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "Constants.h"
+#include "System.h"
 #include "I2C_Handler.h"
+#ifdef I2C_TRACE_ENABLE
+#include "UART_Interface.h"
+#endif
+
+//----------------------------------------------------------------------------------------------------
+//Defines
+//Transfer timeout is a fixed base plus an allowance per byte on the wire (~4x a byte at 100kHz).
+//Unsigned so a long CRC read (105 bytes, 42000 ticks) wraps against TB1CCR1 instead of overflowing
+#define I2C_TIMEOUT_BASE_TICKS  (1*TIMEBASE_TICKS_PER_MS)
+#define I2C_TIMEOUT_BYTE_TICKS  400u
+//Back to back timeouts (transfer or clock-low) before the bus recovery sequence is run
+#define I2C_RECOVER_LIM         2
+//Half of an SCL period while bit-banging the recovery sequence, in MCLK cycles (~50kHz)
+#define I2C_RECOVER_HALFBIT     (MCLK_FREQ_HZ/100000)
+//Bus trace hook, compiles to nothing unless I2C_TRACE_ENABLE is defined
+#ifdef I2C_TRACE_ENABLE
+#define I2C_TRACE(evt, data)    I2C_Trace_Record((evt), (data))
+#else
+#define I2C_TRACE(evt, data)
+#endif
 
 //----------------------------------------------------------------------------------------------------
 //Variables
@@ -22,14 +43,94 @@ unsigned char I2CTXBuf[16];
 unsigned char I2CRXBuf[32];
 
 uint8_t TXByte_CT = 0;
-uint8_t TXBuf_INDEX = 0;
 uint8_t RXByte_CT = 0;
-uint8_t RXBuf_INDEX = 0;
-uint8_t NextTXReg = 0;
-uint8_t NextTXReg2 = 0;
+uint8_t *TXBuf_PTR = 0;
+uint8_t *RXBuf_PTR = 0;
 uint8_t RXedVal = 0;
 
-bool I2CBusy = true;
+//Bit rate prescaler currently loaded in UCB0BRW and the automatic STOP byte count loaded in
+//UCB0TBCNT (0 when the STOP is sent by the ISR)
+static unsigned int CurPrescale = I2C_DFLTPRESCALE;
+static uint8_t CurAutoStop = 0;
+
+//Retry policy for I2C_Transfer(), 3 retries starting at 0.5mS backoff (0.5, 1, 2mS)
+I2CRetry_t I2C_RetryPolicy = {3, TIMEBASE_TICKS_PER_MS/2};
+
+//Result of the most recent I2C_Transfer() and the number of back to back I2C_Transfer() calls
+//that failed even after retries, Fault_Handler uses the latter to qualify a bus fault
+I2CResult_t I2C_LastResult = I2C_OK;
+static unsigned int I2C_FailStreak = 0;
+
+//Set by the Timer1_B CCR2 interrupt when a backoff delay has elapsed
+static volatile bool BackoffDone = false;
+
+//Back to back timeouts seen by I2C_Abort() and the number of bus recoveries run since reset
+static uint8_t I2C_Timeout_CT = 0;
+unsigned int I2C_Recover_CT = 0;
+
+#ifdef I2C_BQ769xxCRC
+//CRC state for the transfer on the bus, CRCPending means the next TX byte is the CRC
+bool CRCMode = false;
+bool CRCPending = false;
+uint8_t CRCVal = 0;
+
+//CRC-8, polynomial x^8+x^2+x+1 (0x07), initial value 0. Kept as a const table in FRAM so the
+//per-byte cost inside USCIB0_ISR is one XOR and one indexed load.
+static const uint8_t CRC8Table[256] =
+{
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+    0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65, 0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+    0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+    0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+    0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2, 0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+    0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+    0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+    0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42, 0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+    0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+    0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+    0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C, 0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+    0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+    0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+    0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B, 0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+    0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+    0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3
+};
+#endif
+
+//Transaction queues, one per priority class. I2CCur is the transfer on the bus (or null if the
+//bus is free), ChunkReg/ChunkBytes describe the piece of it currently being moved.
+static I2CTrans_t *I2CCur = 0;
+static I2CTrans_t *I2CHead[I2C_NUM_PRIO] = {0};
+static I2CTrans_t *I2CTail[I2C_NUM_PRIO] = {0};
+static uint8_t ChunkReg = 0;
+static uint8_t ChunkReg2 = 0;
+static uint8_t ChunkBytes = 0;
+
+//Longest a transfer of each class has waited in its queue before going on the bus, timebase ticks
+unsigned int I2C_MaxQueueTicks[I2C_NUM_PRIO] = {0};
+
+//Set by I2C_HoldBulk() while the main loop has more protection transfers to come
+static bool BulkHeld = false;
+
+//Descriptor used by the blocking I2C_Write/I2C_Read/I2C_Read_Ctrl2 calls
+static I2CTrans_t BlockingTrans;
+
+#ifdef I2C_BENCH
+//Per read results of I2C_Bench() for BenchLen[] bytes, and the ISR entries counting towards them
+static const uint8_t BenchLen[3] = {2, 10, 32};
+unsigned int I2C_BenchTicks[3];
+unsigned int I2C_BenchISRs[3];
+static volatile unsigned int BenchISR_CT = 0;
+#endif
+
+#ifdef I2C_TRACE_ENABLE
+//Bus trace ring buffer. I2C_TraceHead is the next slot written, I2C_TraceTotal counts events since
+//the last dump so the reader can tell how many were overwritten. Recording pauses during a dump.
+I2CTraceRec_t I2C_TraceBuf[I2C_TRACE_LEN];
+uint8_t I2C_TraceHead = 0;
+unsigned int I2C_TraceTotal = 0;
+static volatile bool TracePaused = false;
+#endif
 
 //----------------------------------------------------------------------------------------------------
 //Enumerations
@@ -46,136 +147,524 @@ typedef enum I2CMode_enum{
 
 I2CMode_t I2CMode = IDLE_MODE;
 
+//----------------------------------------------------------------------------------------------------
+//Local Function Prototypes
+static void I2C_Enqueue(I2CTrans_t *trans, bool front);
+static void I2C_Kick(void);
+static void I2C_Start(I2CTrans_t *trans);
+static void I2C_Finish(I2CResult_t result);
+static void I2C_Abort(I2CResult_t result);
+static void I2C_Config(void);
+static void I2C_BusClear(void);
+static unsigned int I2C_DfltPrescale(uint8_t Addr);
+static void I2C_Backoff(unsigned int ticks);
+#ifdef I2C_TRACE_ENABLE
+static inline void I2C_Trace_Record(uint8_t evt, uint8_t data);
+#endif
+
 //------------------------------------------------------//--------------------------------------------
 void Init_I2C()
+{
+    //A slave left mid-byte by a brown-out can hold SDA low forever, free the bus before using it
+    if(!(I2C_AFE_PIN & I2C_AFE_SDA))
+    {   I2C_BusClear();     }
+
+    I2C_Config();
+}
+
+//----------------------------------------------------------------------------------------------------
+// Clock a stuck bus free and bring the eUSCI back up. Safe to call at any time, whatever is on
+// the bus is lost and the transfer in progress (if any) will time out and be retried.
+//------------------------------------------------------//--------------------------------------------
+void I2C_BusRecover(void)
+{
+    I2C_BusClear();
+    I2C_Config();
+    I2C_Recover_CT++;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Standard I2C bus clear: take P1.2/P1.3 back as GPIO, clock SCL up to 9 times until the slave
+// lets go of SDA, then put a STOP on the bus. The pins are driven open-drain style, a line is
+// released by making it an input (external pull-ups) and pulled low by making it an output at 0.
+static void I2C_BusClear(void)
+{
+    unsigned int CT;
+
+    UCB0CTLW0 |= UCSWRST;                               // Hold the eUSCI in reset
+    I2C_AFE_POUT &= ~(I2C_AFE_SDA | I2C_AFE_SCL);       // Output latches low for when driven
+    I2C_AFE_PDIR &= ~(I2C_AFE_SDA | I2C_AFE_SCL);       // Both lines released
+    I2C_AFE_PSEL0 &= ~(I2C_AFE_SDA | I2C_AFE_SCL);      // Reclaim P1.2/P1.3 as GPIO
+    __delay_cycles(I2C_RECOVER_HALFBIT);
+
+    for(CT=0; CT<9 && !(I2C_AFE_PIN & I2C_AFE_SDA); CT++)
+    {
+        I2C_AFE_PDIR |= I2C_AFE_SCL;                    // SCL low
+        __delay_cycles(I2C_RECOVER_HALFBIT);
+        I2C_AFE_PDIR &= ~I2C_AFE_SCL;                   // SCL released
+        __delay_cycles(I2C_RECOVER_HALFBIT);
+    }
+
+    //STOP: SDA goes low while SCL is low, then SCL high, then SDA high
+    I2C_AFE_PDIR |= I2C_AFE_SCL;
+    __delay_cycles(I2C_RECOVER_HALFBIT);
+    I2C_AFE_PDIR |= I2C_AFE_SDA;
+    __delay_cycles(I2C_RECOVER_HALFBIT);
+    I2C_AFE_PDIR &= ~I2C_AFE_SCL;
+    __delay_cycles(I2C_RECOVER_HALFBIT);
+    I2C_AFE_PDIR &= ~I2C_AFE_SDA;
+    __delay_cycles(I2C_RECOVER_HALFBIT);
+
+    I2C_AFE_PSEL0 |= I2C_AFE_SDA | I2C_AFE_SCL;         // Hand the pins back to the eUSCI
+}
+
+//----------------------------------------------------------------------------------------------------
+// Configure USCI_B0 for I2C Master mode
+static void I2C_Config(void)
 {
     // Configure USCI_B0 for I2C Master mode
     UCB0CTLW0 |= UCSWRST;                               // Software reset enabled
     UCB0CTLW0 |= UCMODE_3 | UCMST | UCSYNC;             // I2C mode, Master mode, sync
-    //UCB0CTLW1 |= UCASTP_2;                            // Automatic stop generated after UCB0TBCNT is reached
-    UCB0BRW = 0x00014;                                   // baudrate = SMCLK / 10
+    if(CurAutoStop)
+    {   UCB0CTLW1 = UCCLTO0 | UCASTP_2;                 // Automatic stop generated after UCB0TBCNT is reached
+        UCB0TBCNT = CurAutoStop;                        }
+    else
+    {   UCB0CTLW1 = UCCLTO0 | UCASTP_0;
+        UCB0TBCNT = 0;                                  }
+    UCB0BRW = CurPrescale;                              // baudrate = SMCLK / CurPrescale
     UCB0I2CSA = I2C_BQ769xxADDR;                        // Slave address
-    UCB0CTLW1 |= UCCLTO0;
     //UCB0CTL1 &= ~UCSWRST;                             // Clear software reset (wrong?)
     UCB0CTLW0 &= ~UCSWRST;                              // Clear software reset
-    UCB0IE |=  UCNACKIE | UCCLTOIE;                                // Enable UCB0 Interrupt
+    UCB0IE |=  UCNACKIE | UCCLTOIE | UCALIE;                      // Enable UCB0 Interrupt
 }
 
 //----------------------------------------------------------------------------------------------------
-// I2C Write Function
-// Function takes the address to read from, the control register to read from, and the number of
-// bytes to read back into the RX Buffer
+// Queue a transaction. Returns immediately, the transfer is started right away if the bus is free,
+// otherwise it is started from the ISR once everything ahead of it has completed. The descriptor
+// must stay valid until its Done flag is set.
 //------------------------------------------------------//--------------------------------------------
-bool I2C_Write(uint8_t Addr, uint8_t CtrlReg, uint8_t NumBytes)
+void I2C_Submit(I2CTrans_t *trans)
 {
-    //Setup TX mode and capture control/register byte
-    I2CMode=TX_REG_ADDRESS_MODE;
-    NextTXReg = CtrlReg;
-
-    //Setup all the counts for TX Mode
-    TXByte_CT = NumBytes;
-    TXBuf_INDEX = 0;
-    RXByte_CT = 0;
-    RXBuf_INDEX = 0;
-
-    //Setup the I2C Peripheral for transmitting
-    UCB0I2CSA = Addr;
-    UCB0CTLW0 |= UCTR;                                  // I2C Transmit Mode
-    UCB0IFG &= ~(UCTXIFG + UCRXIFG);                    // Clear any pending interrupts
-    UCB0IE &= ~UCRXIE;                                  // Disable RX interrupt
-    UCB0IE |= UCTXIE;                                   // Enable TX interrupt
+    unsigned short IntState = __get_interrupt_state();
+    __disable_interrupt();
 
-    //Set I2C Busy flag and begin transmission
-    I2CBusy = true;
-    UCB0CTL1 |= UCTXSTT;                                // I2C start condition
+    trans->Done = false;
+    trans->Result = I2C_PENDING;
+    trans->Offset = 0;
+    if(trans->Prio>=I2C_NUM_PRIO)
+    {   trans->Prio = I2C_PRIO_BULK;    }
 
-    //Going to try not going to sleep this time around, leave this commented out
-    __bis_SR_register(GIE);                             // General interrupt enable
-    //Instead processor is awake and idle until message is sent.
-    while(I2CBusy)
-    {   __no_operation();   }
+    I2C_Enqueue(trans, false);
+    I2C_Kick();
 
-    __no_operation();
+    __set_interrupt_state(IntState);
+}
 
-    //For now just return true, in the future return false if there were issues with the transmission
-    return true;
+//----------------------------------------------------------------------------------------------------
+// Sleep in LPM0 until the transaction has completed. Any other interrupt that wakes the CPU just
+// puts it back to sleep here, its flag is left for the main loop to pick up afterwards.
+//------------------------------------------------------//--------------------------------------------
+bool I2C_Wait(I2CTrans_t *trans)
+{
+    __disable_interrupt();
+    while(!trans->Done)
+    {
+        __bis_SR_register(LPM0_bits|GIE);               // Sleep, USCIB0_ISR wakes us on completion
+        __disable_interrupt();
+    }
+    __enable_interrupt();
+
+    return (trans->Result==I2C_OK);
 }
 
 //----------------------------------------------------------------------------------------------------
-// I2C Read Function
+// Run a transaction to completion, retrying with backoff per I2C_RetryPolicy if it fails. Returns
+// the result of the last attempt.
+//------------------------------------------------------//--------------------------------------------
+I2CResult_t I2C_Transfer(I2CTrans_t *trans)
+{
+    uint8_t Retry_CT = 0;
+    unsigned int Backoff = I2C_RetryPolicy.Backoff_Ticks;
+
+    I2C_Submit(trans);
+    while(!I2C_Wait(trans) && Retry_CT<I2C_RetryPolicy.Retry_LIM)
+    {
+        I2C_Backoff(Backoff);
+        Backoff = Backoff<<1;
+        Retry_CT++;
+        I2C_Submit(trans);
+    }
+
+    I2C_LastResult = trans->Result;
+    if(trans->Result==I2C_OK)
+    {   I2C_FailStreak = 0;     }
+    else if(I2C_FailStreak<0x7FFF)
+    {   I2C_FailStreak++;       }
+
+    return trans->Result;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Keep bulk transfers off the bus while hold is set. The fast path sets it around its SYS_STAT read
+// and FET write, without it the next chunk of a bulk transfer would get the bus back in between
+// and the FET write would wait for that chunk as well as for the one on the bus at the ALERT.
+void I2C_HoldBulk(bool hold)
+{
+    unsigned short IntState = __get_interrupt_state();
+    __disable_interrupt();
+
+    BulkHeld = hold;
+    if(!hold)
+    {   I2C_Kick();     }
+
+    __set_interrupt_state(IntState);
+}
+
+//----------------------------------------------------------------------------------------------------
+bool I2C_IsIdle(void)
+{   return (I2CCur==0 && I2CHead[I2C_PRIO_PROT]==0 && I2CHead[I2C_PRIO_BULK]==0);  }
+
+//----------------------------------------------------------------------------------------------------
+unsigned int I2C_Get_FailStreak(void)
+{   return I2C_FailStreak;  }
+
+//----------------------------------------------------------------------------------------------------
+// I2C Write Function
 // Function takes the address to write to, the control register to write, and the number of bytes
 // following the control register to transmit from the TX Buffer Array
 //------------------------------------------------------//--------------------------------------------
-bool I2C_Read(uint8_t Addr, uint8_t CtrlReg, uint8_t NumBytes)
+bool I2C_Write(uint8_t Addr, uint8_t CtrlReg, uint8_t NumBytes)
 {
-    //Setup RX mode and capture control/register byte
-    I2CMode=TX_REG_ADDRESS_MODE;
-    NextTXReg = CtrlReg;
-
-    //Setup all the counts for TX Mode
-    TXByte_CT = 0;
-    TXBuf_INDEX = 0;
-    RXByte_CT = NumBytes;
-    RXBuf_INDEX = 0;
-
-    //Setup the I2C Peripheral for transmitting (TX happens first, then RX)
-    UCB0I2CSA = Addr;
-    UCB0CTLW0 |= UCTR;                                  // I2C Transmit Mode
-    UCB0IFG &= ~(UCTXIFG + UCRXIFG);                    // Clear any pending interrupts
-    UCB0IE &= ~UCRXIE;                                  // Disable RX interrupt
-    UCB0IE |= UCTXIE;                                   // Enable TX interrupt
+    BlockingTrans.Addr = Addr;
+    BlockingTrans.CtrlReg = CtrlReg;
+    BlockingTrans.NumCtrl = 1;
+    BlockingTrans.TXBuf = I2CTXBuf;
+    BlockingTrans.TXBytes = NumBytes;
+    BlockingTrans.RXBuf = 0;
+    BlockingTrans.RXBytes = 0;
+    BlockingTrans.Prescale = 0;
+    BlockingTrans.Prio = (Addr==I2C_BQ769xxADDR) ? I2C_PRIO_PROT : I2C_PRIO_BULK;
+    BlockingTrans.ChunkLen = (Addr==I2C_NTP5312ADDR) ? I2C_NTP5312CHUNK : 0;
+    BlockingTrans.RegShift = (Addr==I2C_NTP5312ADDR) ? I2C_NTP5312REGSHIFT : 0;
+    BlockingTrans.Callback = 0;
+
+    return (I2C_Transfer(&BlockingTrans)==I2C_OK);
+}
 
-    //Set I2C Busy flag and begin transmission
-    I2CBusy = true;
-    UCB0CTL1 |= UCTXSTT;                                // I2C start condition
+//----------------------------------------------------------------------------------------------------
+// I2C Read Function
+// Function takes the address to read from, the control register to read from, and the number of
+// bytes to read back into the RX Buffer
+//------------------------------------------------------//--------------------------------------------
+bool I2C_Read(uint8_t Addr, uint8_t CtrlReg, uint8_t NumBytes)
+{
+    BlockingTrans.Addr = Addr;
+    BlockingTrans.CtrlReg = CtrlReg;
+    BlockingTrans.NumCtrl = 1;
+    BlockingTrans.TXBuf = 0;
+    BlockingTrans.TXBytes = 0;
+    BlockingTrans.RXBuf = I2CRXBuf;
+    BlockingTrans.RXBytes = NumBytes;
+    BlockingTrans.Prescale = 0;
+    BlockingTrans.Prio = (Addr==I2C_BQ769xxADDR) ? I2C_PRIO_PROT : I2C_PRIO_BULK;
+    BlockingTrans.ChunkLen = (Addr==I2C_NTP5312ADDR) ? I2C_NTP5312CHUNK : 0;
+    BlockingTrans.RegShift = (Addr==I2C_NTP5312ADDR) ? I2C_NTP5312REGSHIFT : 0;
+    BlockingTrans.Callback = 0;
+
+    return (I2C_Transfer(&BlockingTrans)==I2C_OK);
+}
 
-    //Not sure if this should be here or not, need to fix for first call during Init
-    __bis_SR_register(GIE);                             // General interrupt enable
+//----------------------------------------------------------------------------------------------------
+// I2C Read Function with a two byte control/register address (NTP5312 memory address)
+//------------------------------------------------------//--------------------------------------------
+bool I2C_Read_Ctrl2(uint8_t Addr, uint8_t CtrlReg, uint8_t CtrlReg2, uint8_t NumBytes)
+{
+    BlockingTrans.Addr = Addr;
+    BlockingTrans.CtrlReg = CtrlReg;
+    BlockingTrans.CtrlReg2 = CtrlReg2;
+    BlockingTrans.NumCtrl = 2;
+    BlockingTrans.TXBuf = 0;
+    BlockingTrans.TXBytes = 0;
+    BlockingTrans.RXBuf = I2CRXBuf;
+    BlockingTrans.RXBytes = NumBytes;
+    BlockingTrans.Prescale = 0;
+    BlockingTrans.Prio = (Addr==I2C_BQ769xxADDR) ? I2C_PRIO_PROT : I2C_PRIO_BULK;
+    BlockingTrans.ChunkLen = (Addr==I2C_NTP5312ADDR) ? I2C_NTP5312CHUNK : 0;
+    BlockingTrans.RegShift = (Addr==I2C_NTP5312ADDR) ? I2C_NTP5312REGSHIFT : 0;
+    BlockingTrans.Callback = 0;
+
+    return (I2C_Transfer(&BlockingTrans)==I2C_OK);
+}
 
-    while(I2CBusy)
-    {   __no_operation();   }
+#ifdef I2C_BENCH
+//----------------------------------------------------------------------------------------------------
+// Read 2, 10 and 32 bytes from SYS_STAT on, I2C_BENCH_RUNS times each, and keep the average time
+// and number of USCI_B0 interrupts per read. Reads of I2C_AUTOSTOP_MIN bytes or more get their
+// STOP from the byte counter, shorter ones from the ISR. Needs interrupts on, nothing else should
+// be using the bus.
+void I2C_Bench(void)
+{
+    unsigned int Start;
+    unsigned int ISRs;
+    unsigned long Ticks;
+    uint8_t Size;
+    uint8_t CT;
 
-    __no_operation();
+    for(Size=0; Size<3; Size++)
+    {
+        ISRs = BenchISR_CT;
+        Ticks = 0;
+        for(CT=0; CT<I2C_BENCH_RUNS; CT++)
+        {   Start = Timebase_Now();
+            I2C_Read(I2C_BQ769xxADDR, REG_SYS_STAT, BenchLen[Size]);
+            Ticks += (uint16_t)(Timebase_Now() - Start);                }
+        I2C_BenchTicks[Size] = Ticks / I2C_BENCH_RUNS;
+        I2C_BenchISRs[Size] = (BenchISR_CT - ISRs) / I2C_BENCH_RUNS;
+    }
+}
+#endif
 
-    //For now just return true, in the future return false if there were issues with the transmission
-    return true;
+//----------------------------------------------------------------------------------------------------
+// Add a transaction to the queue of its class, at the front when it is the next piece of a chunked
+// transfer so it keeps its place. Must be called with interrupts disabled or from the ISR.
+static void I2C_Enqueue(I2CTrans_t *trans, bool front)
+{
+    uint8_t Prio = trans->Prio;
+
+    trans->QueuedAt = Timebase_Now();
+    if(I2CHead[Prio]==0)
+    {   trans->Next = 0;
+        I2CHead[Prio] = trans;
+        I2CTail[Prio] = trans;      }
+    else if(front)
+    {   trans->Next = I2CHead[Prio];
+        I2CHead[Prio] = trans;      }
+    else
+    {   trans->Next = 0;
+        I2CTail[Prio]->Next = trans;
+        I2CTail[Prio] = trans;      }
+}
 
+//----------------------------------------------------------------------------------------------------
+// Start the next queued transaction if the bus is free, protection first and bulk only when not
+// held by I2C_HoldBulk(). Must be called with interrupts disabled or from the ISR. If the STOP of
+// the previous transfer is still going out the start is deferred to the STPIFG interrupt instead
+// of spinning on UCTXSTP. An automatic STOP does not show in UCTXSTP, the bus stays busy until it
+// is done.
+static void I2C_Kick(void)
+{
+    uint8_t Prio = 0;
+    uint8_t Last = BulkHeld ? I2C_PRIO_BULK : I2C_NUM_PRIO;
+    unsigned int Wait;
+
+    if(I2CCur!=0)
+    {   return;     }
+    while(Prio<Last && I2CHead[Prio]==0)
+    {   Prio++;     }
+    if(Prio==Last)
+    {   return;     }
+
+    UCB0IFG &= ~UCSTPIFG;
+    if((UCB0CTLW0 & UCTXSTP) || (UCB0STATW & UCBBUSY))
+    {   UCB0IE |= UCSTPIE;                              // Pick this up again in the STPIFG case
+        return;             }
+    UCB0IE &= ~UCSTPIE;
+
+    I2CCur = I2CHead[Prio];
+    I2CHead[Prio] = I2CCur->Next;
+    if(I2CHead[Prio]==0)
+    {   I2CTail[Prio] = 0;  }
+
+    Wait = (uint16_t)(Timebase_Now() - I2CCur->QueuedAt);
+    if(Wait>I2C_MaxQueueTicks[Prio])
+    {   I2C_MaxQueueTicks[Prio] = Wait;     }
+
+    I2C_Start(I2CCur);
 }
 
-bool I2C_Read_Ctrl2(uint8_t Addr, uint8_t CtrlReg, uint8_t CtrlReg2, uint8_t NumBytes)
+//----------------------------------------------------------------------------------------------------
+// Load the ISR state from a descriptor and put the start condition on the bus
+static void I2C_Start(I2CTrans_t *trans)
 {
-    //Setup RX mode and capture control/register byte
-    I2CMode=TX_REG_ADDRESS_MODE;
-    NextTXReg = CtrlReg;
-    NextTXReg2 = CtrlReg2;
-
-    //Setup all the counts for TX Mode
-    TXByte_CT = 1;
-    TXBuf_INDEX = 0;
-    RXByte_CT = NumBytes;
-    RXBuf_INDEX = 0;
-
-    //Setup the I2C Peripheral for transmitting (TX happens first, then RX)
-    UCB0I2CSA = Addr;
+    unsigned int Prescale;
+    uint8_t AutoStop;
+    unsigned long Pos;
+    unsigned int Reg;
+    uint8_t Room;
+
+    //Setup TX mode, the register byte(s) always go out first
+    I2CMode = TX_REG_ADDRESS_MODE;
+
+    //Work out the piece to move this time, the rest of the data unless it crosses a chunk boundary.
+    //Pos is the byte position in device memory, Reg the address that goes on the wire for it.
+    Reg = trans->CtrlReg;
+    if(trans->NumCtrl==2)
+    {   Reg = (Reg<<8) | trans->CtrlReg2;   }
+    Pos = ((unsigned long)Reg << trans->RegShift) + trans->Offset;
+    Reg = Pos >> trans->RegShift;
+    ChunkBytes = (trans->TXBytes ? trans->TXBytes : trans->RXBytes) - trans->Offset;
+    if(trans->ChunkLen)
+    {   Room = trans->ChunkLen - (Pos & (trans->ChunkLen-1));
+        if(ChunkBytes>Room)
+        {   ChunkBytes = Room;  }       }
+    if(trans->NumCtrl==2)
+    {   ChunkReg = Reg>>8;
+        ChunkReg2 = Reg & 0xFF;     }
+    else
+    {   ChunkReg = Reg & 0xFF;      }
+
+    //Setup all the counts for the transfer
+    TXByte_CT = trans->TXBytes ? ChunkBytes : 0;
+    TXBuf_PTR = trans->TXBuf + trans->Offset;
+    RXByte_CT = trans->RXBytes ? ChunkBytes : 0;
+    RXBuf_PTR = trans->RXBuf + trans->Offset;
+
+#ifdef I2C_BQ769xxCRC
+    //Only the AFE uses CRC, each data byte is followed by its CRC so the RX wire count doubles.
+    //The first CRC of a write covers the write address and register byte as well.
+    CRCMode = (trans->Addr==I2C_BQ769xxADDR);
+    CRCPending = false;
+    if(CRCMode)
+    {   RXByte_CT = RXByte_CT<<1;
+        CRCVal = CRC8Table[CRC8Table[trans->Addr<<1] ^ ChunkReg];   }
+#endif
+
+    //Long reads hand the STOP to the byte counter so it goes out on time however late the RX
+    //interrupt runs. The counter restarts on the repeated start, only the RX bytes are counted.
+    AutoStop = (RXByte_CT>=I2C_AUTOSTOP_MIN) ? RXByte_CT : 0;
+
+    //Switch bit rate if this device runs at a different speed than the last one, same for the
+    //automatic STOP. UCB0BRW and UCB0TBCNT can only be written in reset, which also clears the
+    //interrupt enables, so go through I2C_Config()
+    Prescale = trans->Prescale ? trans->Prescale : I2C_DfltPrescale(trans->Addr);
+    if(Prescale!=CurPrescale || AutoStop!=CurAutoStop)
+    {   CurPrescale = Prescale;
+        CurAutoStop = AutoStop;
+        I2C_Config();           }
+
+    //Arm the transfer timeout, scaled by the number of bytes that will go over the wire
+    TB1CCR1 = Timebase_Now() + I2C_TIMEOUT_BASE_TICKS +
+              (unsigned int)(trans->NumCtrl + TXByte_CT + RXByte_CT) * I2C_TIMEOUT_BYTE_TICKS;
+    TB1CCTL1 = CCIE;
+
+    //Setup the I2C Peripheral for transmitting (TX happens first, then RX if needed)
+    UCB0I2CSA = trans->Addr;
     UCB0CTLW0 |= UCTR;                                  // I2C Transmit Mode
     UCB0IFG &= ~(UCTXIFG + UCRXIFG);                    // Clear any pending interrupts
     UCB0IE &= ~UCRXIE;                                  // Disable RX interrupt
     UCB0IE |= UCTXIE;                                   // Enable TX interrupt
 
-    //Set I2C Busy flag and begin transmission
-    I2CBusy = true;
-    UCB0CTL1 |= UCTXSTT;                                // I2C start condition
+    UCB0CTLW0 |= UCTXSTT;                               // I2C start condition
+    I2C_TRACE(I2CTR_START, trans->Addr);
+    I2C_TRACE(I2CTR_COUNT, ChunkBytes);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Bit rate for a device when the descriptor does not ask for one
+static unsigned int I2C_DfltPrescale(uint8_t Addr)
+{
+    switch(Addr)
+    {
+        case I2C_BQ769xxADDR:   return I2C_BQ769xxPRESCALE;
+        case I2C_NTP5312ADDR:   return I2C_NTP5312PRESCALE;
+        default:                return I2C_DFLTPRESCALE;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Retire the transaction on the bus, notify its owner and move on to the next one. Called from an
+// ISR only, the caller is responsible for waking the CPU on exit. An error recorded earlier in the
+// transfer (CRC) takes precedence over the result passed in. A chunked transfer with data left
+// goes back to the front of its queue instead and is only retired after its last piece.
+static void I2C_Finish(I2CResult_t result)
+{
+    I2CTrans_t *Done = I2CCur;
+
+    TB1CCTL1 &= ~CCIE;                                  // Disarm the transfer timeout
+    UCB0IE &= ~(UCTXIE + UCRXIE);
+    I2CMode = IDLE_MODE;
+    I2CCur = 0;
+
+    if(Done->Result!=I2C_PENDING)
+    {   result = Done->Result;  }
+    I2C_TRACE(I2CTR_DONE, result);
+    if(result==I2C_OK)
+    {
+        I2C_Timeout_CT = 0;
+        Done->Offset += ChunkBytes;
+        if(Done->Offset < (Done->TXBytes ? Done->TXBytes : Done->RXBytes))
+        {   I2C_Enqueue(Done, true);
+            I2C_Kick();
+            return;                     }
+    }
+
+    Done->Result = result;
+    Done->Done = true;
+    if(Done->Callback)
+    {   Done->Callback(Done);   }
 
-    //Not sure if this should be here or not, need to fix for first call during Init
-    __bis_SR_register(GIE);                             // General interrupt enable
+    I2C_Kick();
+}
+
+//----------------------------------------------------------------------------------------------------
+// Drop the transfer on the bus after a timeout or bus error. The eUSCI is put back through reset
+// so it comes out as an idle master no matter what state the error left it in.
+static void I2C_Abort(I2CResult_t result)
+{
+    //Repeated timeouts mean a slave is most likely holding the bus, clock it free this time
+    if(result==I2C_TIMEOUT || result==I2C_CLKLOW_TIMEOUT)
+    {   I2C_Timeout_CT++;   }
+    if(I2C_Timeout_CT>=I2C_RECOVER_LIM)
+    {   I2C_Timeout_CT = 0;
+        I2C_BusRecover();       }
+    else
+    {   I2C_Config();           }
+
+    if(I2CCur)
+    {   I2C_Finish(result);     }
+}
 
-    while(I2CBusy)
-    {   __no_operation();   }
+//----------------------------------------------------------------------------------------------------
+// Sleep for the given number of timebase ticks using Timer1_B CCR2
+static void I2C_Backoff(unsigned int ticks)
+{
+    BackoffDone = false;
+    TB1CCR2 = Timebase_Now() + ticks;
+    TB1CCTL2 = CCIE;
 
-    __no_operation();
+    __disable_interrupt();
+    while(!BackoffDone)
+    {
+        __bis_SR_register(LPM0_bits|GIE);
+        __disable_interrupt();
+    }
+    __enable_interrupt();
+}
 
-    //For now just return true, in the future return false if there were issues with the transmission
-    return true;
+//----------------------------------------------------------------------------------------------------
+// Timer1_B CCR1/CCR2 Interrupt Vector: I2C transfer timeout and retry backoff
+#pragma vector = TIMER1_B1_VECTOR
+__interrupt void TIMER1_B1_ISR(void)
+{
+    switch(__even_in_range(TB1IV, TB1IV_TBIFG))
+    {
+        case TB1IV_NONE:
+            break;
+        case TB1IV_TBCCR1:                                  // Transfer timeout
+            TB1CCTL1 &= ~CCIE;
+            I2C_Abort(I2C_TIMEOUT);
+            __bic_SR_register_on_exit(LPM0_bits);
+            break;
+        case TB1IV_TBCCR2:                                  // Backoff delay elapsed
+            TB1CCTL2 &= ~CCIE;
+            BackoffDone = true;
+            __bic_SR_register_on_exit(LPM0_bits);
+            break;
+        case TB1IV_TBIFG:
+            break;
+        default:
+            break;
+    }
 }
 
 //----------------------------------------------------------------------------------------------------
@@ -184,20 +673,35 @@ bool I2C_Read_Ctrl2(uint8_t Addr, uint8_t CtrlReg, uint8_t CtrlReg2, uint8_t Num
 __interrupt void USCIB0_ISR(void)
 
 {
+#ifdef I2C_BENCH
+    BenchISR_CT++;
+#endif
     switch(__even_in_range(UCB0IV, USCI_I2C_UCBIT9IFG))
     {
     case USCI_NONE: break;                                  // Vector 0: No interrupts
-    case USCI_I2C_UCALIFG: break;                           // Vector 2: ALIFG
+    case USCI_I2C_UCALIFG:                                  // Vector 2: ALIFG
+    {
+          //Arbitration lost drops the eUSCI to slave mode, abort re-inits it as master
+          I2C_Abort(I2C_ARB_LOST);
+          __bic_SR_register_on_exit(LPM0_bits);             // Exit LPM0
+          break;
+    }
     case USCI_I2C_UCNACKIFG:                                // Vector 4: NACKIFG
     {
           UCB0CTLW0 |= UCTXSTP;                             // I2C stop condition
-          I2CBusy = false;
-          //__bic_SR_register_on_exit(LPM0_bits); // Exit LPM0
+          I2C_TRACE(I2CTR_NACK, UCB0I2CSA);
+          if(I2CCur)
+          {   I2C_Finish(I2C_NACK);   }
+          __bic_SR_register_on_exit(LPM0_bits);             // Exit LPM0
           break;
     }
 
     case USCI_I2C_UCSTTIFG: break;                          // Vector 6: STTIFG
-    case USCI_I2C_UCSTPIFG: break;                          // Vector 8: STPIFG
+    case USCI_I2C_UCSTPIFG:                                 // Vector 8: STPIFG
+        //Only enabled while a queued transfer waits for the previous STOP to finish
+        UCB0IE &= ~UCSTPIE;
+        I2C_Kick();
+        break;
     case USCI_I2C_UCRXIFG3: break;                          // Vector 10: RXIFG3
     case USCI_I2C_UCTXIFG3: break;                          // Vector 14: TXIFG3
     case USCI_I2C_UCRXIFG2: break;                          // Vector 16: RXIFG2
@@ -211,18 +715,34 @@ __interrupt void USCIB0_ISR(void)
         RXedVal = UCB0RXBUF;
         if(RXByte_CT)
         {
-            I2CRXBuf[RXBuf_INDEX] = RXedVal;
-            RXBuf_INDEX++;
+#ifdef I2C_BQ769xxCRC
+            if(CRCMode && (RXByte_CT & 0x01))
+            {   //Odd count remaining is always a CRC byte, check it and restart for the next pair
+                if(RXedVal!=CRCVal)
+                {   I2CCur->Result = I2C_CRC_ERROR;  }
+                CRCVal = 0;
+            }
+            else
+#endif
+            {
+#ifdef I2C_BQ769xxCRC
+                CRCVal = CRC8Table[CRCVal ^ RXedVal];
+#endif
+                *RXBuf_PTR = RXedVal;
+                RXBuf_PTR++;
+            }
             RXByte_CT--;
         }
-        if(RXByte_CT==1)
-        {   UCB0CTLW0 |= UCTXSTP;   }
-        else if(RXByte_CT==0)
+        if(RXByte_CT==0)
         {
-            UCB0IE &= ~UCRXIE;
-            I2CMode = IDLE_MODE;                            //Disable RX interrupt
-            I2CBusy = false;
+            if(CurAutoStop)
+            {   I2C_TRACE(I2CTR_STOP, 0);   }
+            I2C_Finish(I2C_OK);
+            __bic_SR_register_on_exit(LPM0_bits);           // Exit LPM0
         }
+        else if(RXByte_CT==1 && !CurAutoStop)
+        {   UCB0CTLW0 |= UCTXSTP;                           // Short read, STOP before the last byte
+            I2C_TRACE(I2CTR_STOP, 0);               }
         break;
 
     //------------------------------------------------------//----------------------------------
@@ -232,19 +752,19 @@ __interrupt void USCIB0_ISR(void)
         switch(I2CMode)
         {
             case TX_REG_ADDRESS_MODE:
-                UCB0TXBUF = NextTXReg;
-                if(RXByte_CT && TXByte_CT==0)
-                {   I2CMode=SWITCH_TO_RX_MODE;  }
-                else if(RXByte_CT && TXByte_CT==1)
-                {   I2CMode=TX_REG_ADDRESS_MODE2;
-                    TXByte_CT=0;                }
+                UCB0TXBUF = ChunkReg;
+                I2C_TRACE(I2CTR_REG, ChunkReg);
+                if(I2CCur->NumCtrl==2)
+                {   I2CMode=TX_REG_ADDRESS_MODE2;   }
+                else if(RXByte_CT)
+                {   I2CMode=SWITCH_TO_RX_MODE;      }
                 else
-                {   I2CMode = TX_DATA_MODE;     }
+                {   I2CMode = TX_DATA_MODE;         }
                 break;
 
             case TX_REG_ADDRESS_MODE2:
-                UCB0TXBUF = NextTXReg2;
-                if(RXByte_CT && TXByte_CT==0)
+                UCB0TXBUF = ChunkReg2;
+                if(RXByte_CT)
                 {   I2CMode=SWITCH_TO_RX_MODE;  }
                 else
                 {   I2CMode = TX_DATA_MODE;     }
@@ -255,28 +775,48 @@ __interrupt void USCIB0_ISR(void)
                 UCB0IE &= ~UCTXIE;                          // Disable TX interrupt
                 UCB0CTLW0 &= ~UCTR;                         // Switch to receiver
                 I2CMode = RX_DATA_MODE;                  // State is to receive data
+#ifdef I2C_BQ769xxCRC
+                //First CRC of a read covers the read address and first data byte
+                CRCVal = CRC8Table[(I2CCur->Addr<<1) | 0x01];
+#endif
                 UCB0CTLW0 |= UCTXSTT;                       // Send repeated start
+                I2C_TRACE(I2CTR_RESTART, RXByte_CT);
 
                 if(RXByte_CT==1)
                 {   //Must send stop since this is the N-1 byte
                     while((UCB0CTLW0 & UCTXSTT));
                     UCB0CTLW0 |= UCTXSTP;                   // Send stop condition
+                    I2C_TRACE(I2CTR_STOP, 0);
                 }
                 break;
 
             case TX_DATA_MODE:
+#ifdef I2C_BQ769xxCRC
+                if(CRCPending)
+                {   //CRC for the data byte that just went out, then restart for the next one
+                    UCB0TXBUF = CRCVal;
+                    CRCVal = 0;
+                    CRCPending = false;
+                }
+                else
+#endif
                 if(TXByte_CT)
                 {
-                    UCB0TXBUF = I2CTXBuf[TXBuf_INDEX];
-                    TXBuf_INDEX++;
+                    UCB0TXBUF = *TXBuf_PTR;
+#ifdef I2C_BQ769xxCRC
+                    if(CRCMode)
+                    {   CRCVal = CRC8Table[CRCVal ^ *TXBuf_PTR];
+                        CRCPending = true;                  }
+#endif
+                    TXBuf_PTR++;
                     TXByte_CT--;
                 }
                 else
                 {
                     UCB0CTLW0 |= UCTXSTP;                   // Send stop condition
-                    I2CMode = IDLE_MODE;
-                    UCB0IE &= ~UCTXIE;                      // disable TX interrupt
-                    I2CBusy = false;
+                    I2C_TRACE(I2CTR_STOP, 0);
+                    I2C_Finish(I2C_OK);
+                    __bic_SR_register_on_exit(LPM0_bits);   // Exit LPM0
                 }
                 break;
 
@@ -290,14 +830,55 @@ __interrupt void USCIB0_ISR(void)
         //P1OUT ^= BIT0;                                    // Toggle LED on P1.0
         break;
 
-    case USCI_I2C_UCCLTOIFG: break;                         // Vector 30: clock low timeout
+    case USCI_I2C_UCCLTOIFG:                                // Vector 30: clock low timeout
     {
-          UCB0CTLW0 |= UCTXSTP;                             // I2C stop condition
-          //__bic_SR_register_on_exit(LPM0_bits); // Exit LPM0
-          I2CBusy = false;
+          I2C_Abort(I2C_CLKLOW_TIMEOUT);
+          __bic_SR_register_on_exit(LPM0_bits);             // Exit LPM0
           break;
     }
     case USCI_I2C_UCBIT9IFG: break;                         // Vector 32: 9th bit
     default: break;
     }
 }
+
+#ifdef I2C_TRACE_ENABLE
+//----------------------------------------------------------------------------------------------------
+// Add an event to the trace ring buffer, ISR or interrupts disabled only
+static inline void I2C_Trace_Record(uint8_t evt, uint8_t data)
+{
+    I2CTraceRec_t *Rec;
+
+    if(TracePaused)
+    {   return;     }
+    Rec = &I2C_TraceBuf[I2C_TraceHead];
+    Rec->Time = TB1R;
+    Rec->Event = evt;
+    Rec->Data = data;
+    I2C_TraceHead = (I2C_TraceHead+1) & (I2C_TRACE_LEN-1);
+    I2C_TraceTotal++;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Send the trace out the UART oldest event first, one "I2CT <time> <event> <data>" line each, then
+// start over. The header line carries how many events were overwritten since the last dump.
+void I2C_Trace_Dump(void)
+{
+    unsigned int Num;
+    unsigned int CT;
+    uint8_t Idx;
+
+    TracePaused = true;
+    Num = (I2C_TraceTotal<I2C_TRACE_LEN) ? I2C_TraceTotal : I2C_TRACE_LEN;
+    Idx = (I2C_TraceHead - Num) & (I2C_TRACE_LEN-1);
+
+    printf("I2CT BEGIN %u %u\n", Num, I2C_TraceTotal-Num);
+    for(CT=0; CT<Num; CT++)
+    {   printf("I2CT %u %u %u\n", I2C_TraceBuf[Idx].Time, I2C_TraceBuf[Idx].Event,
+               I2C_TraceBuf[Idx].Data);
+        Idx = (Idx+1) & (I2C_TRACE_LEN-1);                                          }
+    printf("I2CT END\n");
+
+    I2C_TraceTotal = 0;
+    TracePaused = false;
+}
+#endif
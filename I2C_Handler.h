@@ -14,16 +14,123 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+//----------------------------------------------------------------------------------------------------
+// Outcome of a transaction, written to the descriptor by the ISR
+typedef enum
+{
+    I2C_PENDING,                                    // Queued or still on the bus
+    I2C_OK,
+    I2C_NACK,                                       // Slave did not acknowledge
+    I2C_CLKLOW_TIMEOUT,                             // SCL held low past UCCLTO
+    I2C_ARB_LOST,                                   // Lost arbitration to another master
+    I2C_CRC_ERROR,                                  // Received CRC did not match (CRC parts only)
+    I2C_TIMEOUT                                     // Transfer did not finish in time (Timer1_B)
+} I2CResult_t;
+
+//----------------------------------------------------------------------------------------------------
+// Priority class of a transaction. Whenever the bus frees up the oldest protection transfer goes
+// next, bulk transfers only run when no protection transfer is waiting and I2C_HoldBulk() is off.
+typedef enum
+{
+    I2C_PRIO_PROT,                                  // FET control, SYS_STAT read/clear
+    I2C_PRIO_BULK,                                  // NFC, configuration and anything else
+    I2C_NUM_PRIO
+} I2CPrio_t;
+
+//----------------------------------------------------------------------------------------------------
+// Retry policy used by I2C_Transfer(). A failed transfer is retried up to Retry_LIM times, waiting
+// Backoff_Ticks (timebase ticks) before the first retry and doubling the wait for each one after.
+typedef struct
+{
+    uint8_t Retry_LIM;
+    unsigned int Backoff_Ticks;
+} I2CRetry_t;
+
+//----------------------------------------------------------------------------------------------------
+// Transaction descriptor. Fill one of these out and hand it to I2C_Submit(), the transfer is then
+// run entirely by USCIB0_ISR. The register byte(s) are always written first, followed by either
+// TXBytes of data from TXBuf or a repeated start and RXBytes of data read back into RXBuf.
+// With ChunkLen set the data is moved in pieces that never cross a ChunkLen byte boundary of the
+// device memory, the transfer goes back in its queue between pieces so protection traffic only
+// ever waits for one piece. RegShift says how far the address moves per byte, 0 for byte
+// addressed registers and 2 for the 4 byte blocks of the NTP5312.
+typedef struct I2CTrans_s
+{
+    uint8_t Addr;                                   // 7-bit slave address
+    uint8_t CtrlReg;                                // First register/control byte
+    uint8_t CtrlReg2;                               // Second register/control byte if NumCtrl==2
+    uint8_t NumCtrl;                                // Number of register/control bytes (1 or 2)
+    uint8_t *TXBuf;                                 // Data written after the register byte(s)
+    uint8_t TXBytes;
+    uint8_t *RXBuf;                                 // Data read back after the repeated start
+    uint8_t RXBytes;
+    unsigned int Prescale;                          // SMCLK/bit rate, 0 picks the default for Addr
+    uint8_t Prio;                                   // I2CPrio_t
+    uint8_t ChunkLen;                               // Page size to split at (power of 2), 0 = none
+    uint8_t RegShift;                               // log2 of the data bytes behind one address
+
+    volatile bool Done;                             // Set by the ISR when the transfer finishes
+    volatile I2CResult_t Result;                    // Set by the ISR along with Done
+    void (*Callback)(struct I2CTrans_s *trans);     // Optional, called from the ISR when done
+
+    struct I2CTrans_s *Next;                        // Queue link, owned by I2C_Handler
+    uint8_t Offset;                                 // Data bytes already moved, owned by I2C_Handler
+    unsigned int QueuedAt;                          // Timebase when queued, owned by I2C_Handler
+} I2CTrans_t;
+
+//----------------------------------------------------------------------------------------------------
+// Bus trace, only recorded when built with I2C_TRACE_ENABLE. Each event is stamped with Timer1_B
+// (1uS) as the ISR sees it. I2C_TraceBuf can be read with the debugger or drained over the UART
+// with I2C_Trace_Dump(), HostSim/Trace_Decode turns a dump into per transfer latencies.
+typedef enum
+{
+    I2CTR_START,                                    // Start and address, Data = 7-bit address
+    I2CTR_REG,                                      // First register byte, Data = register
+    I2CTR_COUNT,                                    // Data bytes in this transfer or chunk
+    I2CTR_RESTART,                                  // Repeated start for the read
+    I2CTR_NACK,                                     // Data = 7-bit address
+    I2CTR_STOP,                                     // STOP requested, or left to the byte counter
+    I2CTR_DONE                                      // Transfer or chunk retired, Data = I2CResult_t
+} I2CTraceEvt_t;
+
+typedef struct
+{
+    uint16_t Time;                                  // TB1R
+    uint8_t Event;                                  // I2CTraceEvt_t
+    uint8_t Data;
+} I2CTraceRec_t;
+
 //----------------------------------------------------------------------------------------------------
 // Function Prototypes
 void Init_I2C();
+void I2C_BusRecover(void);
+void I2C_Submit(I2CTrans_t *trans);
+bool I2C_Wait(I2CTrans_t *trans);
+I2CResult_t I2C_Transfer(I2CTrans_t *trans);
+void I2C_HoldBulk(bool hold);
+bool I2C_IsIdle(void);
+unsigned int I2C_Get_FailStreak(void);
+
 bool I2C_Write(uint8_t Addr, uint8_t CtrlReg, uint8_t NumBytes);
 bool I2C_Read(uint8_t Addr, uint8_t CtrlReg, uint8_t NumBytes);
 bool I2C_Read_Ctrl2(uint8_t Addr, uint8_t CtrlReg, uint8_t CtrlReg2, uint8_t NumBytes);
+void I2C_Trace_Dump(void);
+void I2C_Bench(void);
 
 //----------------------------------------------------------------------------------------------------
 // Global Variables
 extern unsigned char I2CTXBuf[16];
 extern unsigned char I2CRXBuf[32];
+extern I2CRetry_t I2C_RetryPolicy;
+extern I2CResult_t I2C_LastResult;
+extern unsigned int I2C_Recover_CT;
+extern unsigned int I2C_MaxQueueTicks[I2C_NUM_PRIO];
+extern I2CTraceRec_t I2C_TraceBuf[];
+extern uint8_t I2C_TraceHead;
+extern unsigned int I2C_TraceTotal;
+#ifdef I2C_BENCH
+extern unsigned int I2C_BenchTicks[3];
+extern unsigned int I2C_BenchISRs[3];
+#endif
 
 #endif
@@ -0,0 +1,203 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Latency_Handler.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * ALERT to FET write latency of every fault cycle and of every trip, timed on the Timer1_B
+ * timebase, kept as min/max/histograms in RAM and reported over the UART
+----------------------------------------------------------------------------------------------------*/
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+#include "System.h"
+#include "Persistent.h"
+#include "UART_Interface.h"
+#include "Latency_Handler.h"
+
+//----------------------------------------------------------------------------------------------------
+// The Port_1 ISR stamps the ALERT edge, the main loop stamps the snapshot read, the fault decision
+// and the end of the flush that writes the FETs, all from the free running Timer1_B (1uS). The
+// ALERT pin is not on a Timer_B capture input, and the timebase runs off SMCLK in step with the
+// CPU, so a read of TB1R at the top of the ISR is what a capture would hold plus the ISR entry.
+// Latency_Commit turns the four stamps into per stage stats, and the ALERT to FET time also goes
+// into the stats of every protection that tripped in the fast pass. Rows of the bulk pass only get
+// their FETs on the second flush, Latency_Trips times those to the end of it. A cycle that was
+// started by the backup check-in instead of an edge has no ALERT stamp and is only counted in
+// Latency_Missed_CT. An edge that comes in during init is dropped by Latency_Start, the loop could
+// not have acted on it any sooner, so its cycle is neither timed nor counted.
+// Stamps are 16 bit, good for cycles under 65mS, far beyond LAT_BOUND_TICKS.
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+LatStats_t Latency_Stage[LAT_NUM_STAGES];
+LatStats_t Latency_Fault[FAULT_NUM];
+uint16_t Latency_Over_CT = 0;                       //Cycles with ALERT to FET over LAT_BOUND_TICKS
+uint16_t Latency_Missed_CT = 0;                     //Cycles without an ALERT stamp
+
+static volatile uint16_t AlertTick = 0;
+static volatile bool AlertValid = false;
+static uint16_t Marks[LAT_NUM_MARKS];
+static bool Timed = false;
+static bool Skip = false;                           //Next cycle is the one of an init ALERT
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static void Latency_Add(LatStats_t *stats, uint16_t ticks);
+static void Latency_Print(char type, uint8_t id, LatStats_t *stats);
+
+//------------------------------------------------------//--------------------------------------------
+// From the Port_1 ISR, first thing
+void Latency_Alert(void)
+{
+    AlertTick = Timebase_Now();
+    AlertValid = true;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Right before the main loop, drops an ALERT stamped during init
+void Latency_Start(void)
+{
+    __disable_interrupt();
+    Skip = AlertValid;
+    AlertValid = false;
+    __enable_interrupt();
+}
+
+//----------------------------------------------------------------------------------------------------
+// LAT_ALERT takes over the ISR stamp and starts the cycle, the other marks read the timebase
+void Latency_Mark(LatMark_t mark)
+{
+    if(mark!=LAT_ALERT)
+    {   Marks[mark] = Timebase_Now();
+        return;                         }
+
+    __disable_interrupt();
+    Marks[LAT_ALERT] = AlertTick;
+    Timed = AlertValid;
+    AlertValid = false;
+    __enable_interrupt();
+}
+
+//----------------------------------------------------------------------------------------------------
+// After LAT_FET, trips holds the Fault_Table rows that tripped in the fast pass
+void Latency_Commit(uint32_t trips)
+{
+    uint16_t Total;
+    uint8_t CT;
+    bool Skipped = Skip;
+
+    Skip = false;
+    if(!Timed)
+    {   if(!Skipped && Latency_Missed_CT<0xFFFF)
+        {   Latency_Missed_CT++;    }
+        return;                                     }
+
+    Total = Marks[LAT_FET] - Marks[LAT_ALERT];
+    Latency_Add(&Latency_Stage[LAT_ALERT_STAT], Marks[LAT_STAT] - Marks[LAT_ALERT]);
+    Latency_Add(&Latency_Stage[LAT_STAT_DECIDE], Marks[LAT_DECIDE] - Marks[LAT_STAT]);
+    Latency_Add(&Latency_Stage[LAT_DECIDE_FET], Marks[LAT_FET] - Marks[LAT_DECIDE]);
+    Latency_Add(&Latency_Stage[LAT_ALERT_FET], Total);
+    if(Total>LAT_BOUND_TICKS && Latency_Over_CT<0xFFFF)
+    {   Latency_Over_CT++;  }
+
+    for(CT=0; trips; CT++, trips>>=1)
+    {   if(trips & 1)
+        {   Latency_Add(&Latency_Fault[CT], Total);     }   }
+}
+
+//----------------------------------------------------------------------------------------------------
+// After the bulk flush, trips holds the Fault_Table rows that tripped in the bulk pass
+void Latency_Trips(uint32_t trips)
+{
+    uint16_t Total;
+    uint8_t CT;
+
+    if(!Timed || !trips)
+    {   return;     }
+
+    Total = Timebase_Now() - Marks[LAT_ALERT];
+    for(CT=0; trips; CT++, trips>>=1)
+    {   if(trips & 1)
+        {   Latency_Add(&Latency_Fault[CT], Total);     }   }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Send the stats out the UART and start them over. Lines are
+//   LAT BEGIN <over bound> <missed> <bound> <first bin>
+//   LAT S <stage> <num> <min> <max> <avg> <hist...>      for every LatStage_t
+//   LAT F <fault> <num> <min> <max> <avg> <hist...>      for every FaultID_t that tripped
+//   LAT END
+void Latency_Report(void)
+{
+    uint8_t CT;
+
+    printf("LAT BEGIN %u %u %u %u\n", Latency_Over_CT, Latency_Missed_CT, LAT_BOUND_TICKS,
+           LAT_FIRST_BIN_TICKS);
+    for(CT=0; CT<LAT_NUM_STAGES; CT++)
+    {   Latency_Print('S', CT, &Latency_Stage[CT]);     }
+    for(CT=0; CT<FAULT_NUM; CT++)
+    {   if(Latency_Fault[CT].Num)
+        {   Latency_Print('F', CT, &Latency_Fault[CT]);     }   }
+    printf("LAT END\n");
+
+    for(CT=0; CT<LAT_NUM_STAGES; CT++)
+    {   Latency_Stage[CT].Num = 0;  }
+    for(CT=0; CT<FAULT_NUM; CT++)
+    {   Latency_Fault[CT].Num = 0;  }
+    Latency_Over_CT = 0;
+    Latency_Missed_CT = 0;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Num==0 marks empty stats, the rest is started over by the first sample. Stops counting at 65535
+// samples (4.5 hours of cycles) except for Min/Max.
+static void Latency_Add(LatStats_t *stats, uint16_t ticks)
+{
+    uint32_t Limit = LAT_FIRST_BIN_TICKS;
+    uint8_t Bin = 0;
+
+    if(stats->Num==0)
+    {   stats->Min = ticks;
+        stats->Max = ticks;
+        stats->Sum = 0;
+        for(Bin=0; Bin<LAT_NUM_BINS; Bin++)
+        {   stats->Hist[Bin] = 0;   }
+        Bin = 0;                            }
+
+    if(ticks<stats->Min)
+    {   stats->Min = ticks;     }
+    if(ticks>stats->Max)
+    {   stats->Max = ticks;     }
+    if(stats->Num==0xFFFF)
+    {   return;     }
+
+    while(Bin<LAT_NUM_BINS-1 && ticks>=Limit)
+    {   Bin++;
+        Limit <<= 1;    }
+    stats->Hist[Bin]++;
+    stats->Sum += ticks;
+    stats->Num++;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void Latency_Print(char type, uint8_t id, LatStats_t *stats)
+{
+    uint8_t Bin;
+
+    if(stats->Num==0)
+    {   printf("LAT %c %u 0 0 0 0", type, id);
+        for(Bin=0; Bin<LAT_NUM_BINS; Bin++)
+        {   printf(" 0");   }
+        printf("\n");
+        return;                                         }
+
+    printf("LAT %c %u %u %u %u %u", type, id, stats->Num, stats->Min, stats->Max,
+           (uint16_t)(stats->Sum/stats->Num));
+    for(Bin=0; Bin<LAT_NUM_BINS; Bin++)
+    {   printf(" %u", stats->Hist[Bin]);    }
+    printf("\n");
+}
@@ -0,0 +1,75 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: Latency_Handler.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * ALERT to FET write latency of every fault cycle and of every trip, timed on the Timer1_B
+ * timebase, kept as min/max/histograms in RAM and reported over the UART
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef LATENCY_HANDLER_H
+#define LATENCY_HANDLER_H
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+#include "Persistent.h"
+
+//----------------------------------------------------------------------------------------------------
+// Enumerations
+
+//Points of a fault cycle that get a timestamp, in the order they happen:
+typedef enum
+{
+    LAT_ALERT,                  //ALERT edge, Port_1 ISR
+    LAT_STAT,                   //SYS_STAT and CC read back
+    LAT_DECIDE,                 //Fast fault pass evaluated, FET bits known
+    LAT_FET,                    //FET bits written to SYS_CTRL2 (fast flush)
+    LAT_NUM_MARKS
+} LatMark_t;
+
+//Stats kept per cycle, the time between two marks:
+typedef enum
+{
+    LAT_ALERT_STAT,
+    LAT_STAT_DECIDE,
+    LAT_DECIDE_FET,
+    LAT_ALERT_FET,
+    LAT_NUM_STAGES
+} LatStage_t;
+
+//----------------------------------------------------------------------------------------------------
+// Structs
+
+//----------------------------------------------------------------------------------------------------
+// In timebase ticks (1uS). Hist[n] counts samples below LAT_FIRST_BIN_TICKS<<n, the last bin
+// everything above. Num saturates, Sum/Num is the average.
+typedef struct
+{
+    uint16_t Min;
+    uint16_t Max;
+    uint32_t Sum;
+    uint16_t Num;
+    uint16_t Hist[LAT_NUM_BINS];
+} LatStats_t;
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void Latency_Alert(void);
+void Latency_Start(void);
+void Latency_Mark(LatMark_t mark);
+void Latency_Commit(uint32_t trips);
+void Latency_Trips(uint32_t trips);
+void Latency_Report(void);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern LatStats_t Latency_Stage[LAT_NUM_STAGES];
+extern LatStats_t Latency_Fault[FAULT_NUM];
+extern uint16_t Latency_Over_CT;
+extern uint16_t Latency_Missed_CT;
+
+#endif
@@ -17,62 +17,118 @@
 
 #pragma PERSISTENT(OVP_Latch);
 #pragma PERSISTENT(OVP_Clear);
-#pragma PERSISTENT(OVP_Pair);
 Qual_AFE_t OVP_Latch = {2, 0x00};
-Qual_MCU_t OVP_Clear = {NEGATIVE, 0x2329, 0x2328  , 0, 20};
-FaultPair_AFE_MCU_t OVP_Pair =  {CLEARED, &OVP_Latch, &OVP_Clear, 0, BIT2,
-                                        0, 7, BiColor_GREEN};
+Qual_MCU_t OVP_Clear = {NEGATIVE, 3439, 3438, 0, 20};              //mV
 #pragma PERSISTENT(UVP_Latch);
 #pragma PERSISTENT(UVP_Clear);
-#pragma PERSISTENT(UVP_Pair);
 Qual_AFE_t UVP_Latch = {3, 0x00};
-Qual_MCU_t UVP_Clear = {POSITIVE, 0x1771, 0x1770, 0, 20};
-FaultPair_AFE_MCU_t UVP_Pair =  {CLEARED, &UVP_Latch, &UVP_Clear, 0, BIT3,
-                                        0, 7, BiColor_RED};
+Qual_MCU_t UVP_Clear = {POSITIVE, 2293, 2292, 0, 20};              //mV
 
 #pragma PERSISTENT(SCPD_Latch);
 #pragma PERSISTENT(SCPD_Clear);
-#pragma PERSISTENT(SCPD_Pair);
-Qual_AFE_t SCPD_Latch = {0, 0x00};
-Qual_AUR_t SCPD_Clear = {false, 0, 40, 0, 3, false};;
-FaultPair_AFE_AUR_t SCPD_Pair =  {CLEARED, &SCPD_Latch, &SCPD_Clear, 0, BIT1,
-                                         0, 6, BiColor_RED};
+Qual_AFE_t SCPD_Latch = {1, 0x00};
+Qual_AUR_t SCPD_Clear = {true, 0, 120, 0, 1, false, 0};      //Retry once after 30S
 
 #pragma PERSISTENT(OCPD_Latch);
 #pragma PERSISTENT(OCPD_Clear);
-#pragma PERSISTENT(OCPD_Pair);
 Qual_AFE_t OCPD_Latch = {0, 0x00};
-Qual_AUR_t OCPD_Clear = {false, 0, 40, 0, 3, false};;
-FaultPair_AFE_AUR_t OCPD_Pair =  {CLEARED, &OCPD_Latch, &OCPD_Clear, 0, BIT0,
-                                         0, 5, BiColor_RED};
+Qual_AUR_t OCPD_Clear = {true, 0, 40, 0, 3, false, 0};       //Up to 3 times, 10S apart
 
 #pragma PERSISTENT(BCPD_Latch);
 #pragma PERSISTENT(BCPD_Clear);
-#pragma PERSISTENT(BCPD_Pair);
 Qual_MCU_t BCPD_Latch = {NEGATIVE, 0x0000, BCPD_Thresh, 0, 4};
-Qual_AUR_t BCPD_Clear = {false, 0, 40, 0, 3, false};
-FaultPair_MCU_AUR_t BCPD_Pair =  {CLEARED, &BCPD_Latch, &BCPD_Clear, 0,
-                                         0, 4, BiColor_RED};
+Qual_AUR_t BCPD_Clear = {true, 0, 40, 0, 3, false, 0};
 
 #pragma PERSISTENT(MCPD_Latch);
 #pragma PERSISTENT(MCPD_Clear);
-#pragma PERSISTENT(MCPD_Pair);
 Qual_MCU_t MCPD_Latch = {NEGATIVE, 0x0000, MCPD_Thresh, 0, 40};
-Qual_AUR_t MCPD_Clear = {false, 0, 40, 0, 3, false};
-FaultPair_MCU_AUR_t MCPD_Pair =  {CLEARED, &MCPD_Latch, &MCPD_Clear, 0,
-                                         0, 3, BiColor_RED};
+Qual_AUR_t MCPD_Clear = {true, 0, 40, 0, 3, false, 0};
 
 #pragma PERSISTENT(BCPC_Latch);
 #pragma PERSISTENT(BCPC_Clear);
-#pragma PERSISTENT(BCPC_Pair);
 Qual_MCU_t BCPC_Latch = {POSITIVE, 0x0000, BCPC_Thresh, 0, 4};
-Qual_AUR_t BCPC_Clear = {false, 0, 40, 0, 3, false};
-FaultPair_MCU_AUR_t BCPC_Pair =  {CLEARED, &BCPC_Latch, &BCPC_Clear, 0,
-                                         0, 4, BiColor_GREEN};
+Qual_AUR_t BCPC_Clear = {true, 0, 40, 0, 3, false, 0};
 
 #pragma PERSISTENT(MCPC_Latch);
 #pragma PERSISTENT(MCPC_Clear);
-#pragma PERSISTENT(MCPC_Pair);
 Qual_MCU_t MCPC_Latch = {POSITIVE, 0x0000, MCPC_Thresh, 0, 40};
-Qual_AUR_t MCPC_Clear = {false, 0, 40, 0, 3, false};
-FaultPair_MCU_AUR_t MCPC_Pair =  {CLEARED, &MCPC_Latch, &MCPC_Clear, 0, 3, BiColor_GREEN};
+Qual_AUR_t MCPC_Clear = {true, 0, 40, 0, 3, false, 0};
+
+#pragma PERSISTENT(BUSF_Latch);
+#pragma PERSISTENT(BUSF_Clear);
+Qual_MCU_t BUSF_Latch = {POSITIVE, 0x0000, BUSF_Thresh, 0, 0};
+Qual_MCU_t BUSF_Clear = {NEGATIVE, 0x0000, 1, 0, 4};
+
+#pragma PERSISTENT(OTPC_Latch);
+#pragma PERSISTENT(OTPC_Clear);
+Qual_MCU_t OTPC_Latch = {POSITIVE, 0x0000, OTPC_Thresh, 0, 8};     //0.1C
+Qual_MCU_t OTPC_Clear = {NEGATIVE, 0x0000, OTPC_Thresh-TEMP_HYST_dC, 0, 8};
+
+#pragma PERSISTENT(OTPD_Latch);
+#pragma PERSISTENT(OTPD_Clear);
+Qual_MCU_t OTPD_Latch = {POSITIVE, 0x0000, OTPD_Thresh, 0, 8};     //0.1C
+Qual_MCU_t OTPD_Clear = {NEGATIVE, 0x0000, OTPD_Thresh-TEMP_HYST_dC, 0, 8};
+
+#pragma PERSISTENT(OTPS_Latch);
+#pragma PERSISTENT(OTPS_Clear);
+Qual_MCU_t OTPS_Latch = {POSITIVE, 0x0000, OTPS_Thresh, 0, 8};     //0.1C
+Qual_MCU_t OTPS_Clear = {NEGATIVE, 0x0000, OTPS_Thresh-TEMP_HYST_dC, 0, 8};
+
+#pragma PERSISTENT(UTPP_Latch);
+#pragma PERSISTENT(UTPP_Clear);
+Qual_MCU_t UTPP_Latch = {NEGATIVE, 0x0000, UTPP_Thresh, 0, 8};     //0.1C
+Qual_MCU_t UTPP_Clear = {POSITIVE, 0x0000, UTPP_Thresh+TEMP_HYST_dC, 0, 8};
+
+#pragma PERSISTENT(OTPP_Latch);
+#pragma PERSISTENT(OTPP_Clear);
+Qual_MCU_t OTPP_Latch = {POSITIVE, 0x0000, OTPP_Thresh, 0, 8};     //0.1C
+Qual_MCU_t OTPP_Clear = {NEGATIVE, 0x0000, OTPP_Thresh-TEMP_HYST_dC, 0, 8};
+
+#pragma PERSISTENT(UTPB_Latch);
+#pragma PERSISTENT(UTPB_Clear);
+Qual_MCU_t UTPB_Latch = {NEGATIVE, 0x0000, UTPB_Thresh, 0, 8};     //0.1C
+Qual_MCU_t UTPB_Clear = {POSITIVE, 0x0000, UTPB_Thresh+TEMP_HYST_dC, 0, 8};
+
+#pragma PERSISTENT(OTPB_Latch);
+#pragma PERSISTENT(OTPB_Clear);
+Qual_MCU_t OTPB_Latch = {POSITIVE, 0x0000, OTPB_Thresh, 0, 8};     //0.1C
+Qual_MCU_t OTPB_Clear = {NEGATIVE, 0x0000, OTPB_Thresh-TEMP_HYST_dC, 0, 8};
+
+//----------------------------------------------------------------------------------------------------
+// Fault table, one row per protection in FaultID_t order (lowest LED priority first). FETs are held
+// open while tripped: a cold battery may still be discharged, and OTPC/OTPD only open the hot FET.
+// Bit is the SYS_STAT bit to clear on recovery, LED the blinks and color shown when it trips.
+#define Q_AFE(q)        FAULT_QUAL_AFE, {.AFE=&(q)}
+#define Q_MCU(q)        FAULT_QUAL_MCU, {.MCU=&(q)}
+#define Q_AUR(q)        FAULT_QUAL_AUR, {.AUR=&(q)}
+#define FET_CHG         BIT0
+#define FET_DSG         BIT1
+#define FET_BOTH        (BIT1+BIT0)
+
+const FaultDesc_t Fault_Table[FAULT_NUM] =
+{
+//   Latch              Clear              Input                   FETs      Bit   LED
+    {Q_MCU(MCPC_Latch), Q_AUR(MCPC_Clear), FAULT_IN_CURRENT,       FET_DSG,  0,    3, BiColor_GREEN},
+    {Q_MCU(BCPC_Latch), Q_AUR(BCPC_Clear), FAULT_IN_CURRENT,       FET_DSG,  0,    4, BiColor_GREEN},
+    {Q_MCU(MCPD_Latch), Q_AUR(MCPD_Clear), FAULT_IN_CURRENT,       FET_DSG,  0,    3, BiColor_RED},
+    {Q_MCU(BCPD_Latch), Q_AUR(BCPD_Clear), FAULT_IN_CURRENT,       FET_DSG,  0,    4, BiColor_RED},
+    {Q_MCU(OTPC_Latch), Q_MCU(OTPC_Clear), FAULT_IN_TS+TS_CFET,    FET_CHG,  0,    1, BiColor_YELLOW},
+    {Q_MCU(OTPD_Latch), Q_MCU(OTPD_Clear), FAULT_IN_TS+TS_DFET,    FET_DSG,  0,    2, BiColor_YELLOW},
+    {Q_MCU(OTPS_Latch), Q_MCU(OTPS_Clear), FAULT_IN_TS+TS_RSENSE,  FET_BOTH, 0,    3, BiColor_YELLOW},
+    {Q_MCU(UTPP_Latch), Q_MCU(UTPP_Clear), FAULT_IN_TS+TS_PCB,     FET_BOTH, 0,    4, BiColor_YELLOW},
+    {Q_MCU(OTPP_Latch), Q_MCU(OTPP_Clear), FAULT_IN_TS+TS_PCB,     FET_BOTH, 0,    5, BiColor_YELLOW},
+    {Q_MCU(UTPB_Latch), Q_MCU(UTPB_Clear), FAULT_IN_TS+TS_BATTERY, FET_CHG,  0,    6, BiColor_YELLOW},
+    {Q_MCU(OTPB_Latch), Q_MCU(OTPB_Clear), FAULT_IN_TS+TS_BATTERY, FET_BOTH, 0,    7, BiColor_YELLOW},
+    {Q_AFE(OCPD_Latch), Q_AUR(OCPD_Clear), FAULT_IN_NONE,          FET_DSG,  BIT0, 5, BiColor_RED},
+    {Q_AFE(SCPD_Latch), Q_AUR(SCPD_Clear), FAULT_IN_NONE,          FET_DSG,  BIT1, 6, BiColor_RED},
+    {Q_AFE(UVP_Latch),  Q_MCU(UVP_Clear),  FAULT_IN_VCELL_MIN,     FET_DSG,  BIT3, 7, BiColor_RED},
+    {Q_AFE(OVP_Latch),  Q_MCU(OVP_Clear),  FAULT_IN_VCELL_MAX,     FET_CHG,  BIT2, 7, BiColor_GREEN},
+    {Q_MCU(BUSF_Latch), Q_MCU(BUSF_Clear), FAULT_IN_BUSFAIL,       FET_BOTH, 0,    8, BiColor_YELLOW},
+};
+
+//----------------------------------------------------------------------------------------------------
+// Fault state, kept over a reset like the qualifiers. A zeroed image has everything CLEARED.
+#pragma PERSISTENT(Fault_Tripped);
+#pragma PERSISTENT(Fault_Trips);
+uint32_t Fault_Tripped = 0;
+unsigned int Fault_Trips[FAULT_NUM] = {0};
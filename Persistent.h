@@ -16,36 +16,79 @@
 #include <System.h>
 #include <Fault_Handler.h>
 
+//----------------------------------------------------------------------------------------------------
+// Rows of Fault_Table, lowest LED priority first, and their bit numbers in Fault_Tripped (32 max)
+typedef enum
+{
+    FAULT_MCPC,
+    FAULT_BCPC,
+    FAULT_MCPD,
+    FAULT_BCPD,
+    FAULT_OTPC,
+    FAULT_OTPD,
+    FAULT_OTPS,
+    FAULT_UTPP,
+    FAULT_OTPP,
+    FAULT_UTPB,
+    FAULT_OTPB,
+    FAULT_OCPD,
+    FAULT_SCPD,
+    FAULT_UVP,
+    FAULT_OVP,
+    FAULT_BUSF,
+    FAULT_NUM
+} FaultID_t;
+
+extern const FaultDesc_t Fault_Table[FAULT_NUM];
+extern uint32_t Fault_Tripped;          //Bit n set while Fault_Table[n] is TRIPPED
+extern unsigned int Fault_Trips[FAULT_NUM];
+
 extern Qual_AFE_t OVP_Latch;            //Change to OVPR (Over Voltage PRotection)
 extern Qual_MCU_t OVP_Clear;
-extern FaultPair_AFE_MCU_t OVP_Pair;
 
 extern Qual_AFE_t UVP_Latch;            //Change to UVPR (Under Voltage PRotection)
 extern Qual_MCU_t UVP_Clear;
-extern FaultPair_AFE_MCU_t UVP_Pair;
 
 extern Qual_AFE_t SCPD_Latch;
 extern Qual_AUR_t SCPD_Clear;
-extern FaultPair_AFE_AUR_t SCPD_Pair;
 
 extern Qual_AFE_t OCPD_Latch;
 extern Qual_AUR_t OCPD_Clear;
-extern FaultPair_AFE_AUR_t OCPD_Pair;
 
 extern Qual_MCU_t BCPD_Latch;
 extern Qual_AUR_t BCPD_Clear;
-extern FaultPair_MCU_AUR_t BCPD_Pair;
 
 extern Qual_MCU_t MCPD_Latch;
 extern Qual_AUR_t MCPD_Clear;
-extern FaultPair_MCU_AUR_t MCPD_Pair;
 
 extern Qual_MCU_t BCPC_Latch;
 extern Qual_AUR_t BCPC_Clear;
-extern FaultPair_MCU_AUR_t BCPC_Pair;
 
 extern Qual_MCU_t MCPC_Latch;
 extern Qual_AUR_t MCPC_Clear;
-extern FaultPair_MCU_AUR_t MCPC_Pair;
+
+extern Qual_MCU_t BUSF_Latch;           //I2C BUS Fault
+extern Qual_MCU_t BUSF_Clear;
+
+extern Qual_MCU_t OTPC_Latch;           //Over Temperature Protection, Charge FET
+extern Qual_MCU_t OTPC_Clear;
+
+extern Qual_MCU_t OTPD_Latch;           //Over Temperature Protection, Discharge FET
+extern Qual_MCU_t OTPD_Clear;
+
+extern Qual_MCU_t OTPS_Latch;           //Over Temperature Protection, Sense resistor
+extern Qual_MCU_t OTPS_Clear;
+
+extern Qual_MCU_t UTPP_Latch;           //Under Temperature Protection, PCB
+extern Qual_MCU_t UTPP_Clear;
+
+extern Qual_MCU_t OTPP_Latch;           //Over Temperature Protection, PCB
+extern Qual_MCU_t OTPP_Clear;
+
+extern Qual_MCU_t UTPB_Latch;           //Under Temperature Protection, Battery
+extern Qual_MCU_t UTPB_Clear;
+
+extern Qual_MCU_t OTPB_Latch;           //Over Temperature Protection, Battery
+extern Qual_MCU_t OTPB_Clear;
 
 #endif /* PERSISTENT_H */
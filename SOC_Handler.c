@@ -0,0 +1,139 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: SOC_Handler.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * State of charge from the coulomb counter, corrected from the cell OCV after a long rest and kept
+ * in FRAM across resets
+----------------------------------------------------------------------------------------------------*/
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Constants.h"
+#include "System.h"
+#include "BatteryData.h"
+#include "Balance_Handler.h"
+#include "SOC_Handler.h"
+
+//----------------------------------------------------------------------------------------------------
+// Each alert cycle only adds the new CC sample to a 32 bit accumulator and counts rest time, the
+// divisions to mAh or SOC are left to whoever asks for them. The accumulator goes to FRAM every
+// SOC_SAVE_CYCLES samples. After SOC_REST_CYCLES samples of rest the lowest cell's voltage is
+// taken as its OCV (from a snapshot without bleed current) and the charge is reset from the OCV
+// table, once per rest period. With no valid FRAM copy at startup (first boot) the charge is seeded
+// from the OCV on the first sample.
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define SOC_FULL_CC             ((int32_t)PACK_CAPACITY_mAh*CC_COUNTS_PER_mAh)
+#define SOC_CC_PER_PERMILLE     (SOC_FULL_CC/1000)
+#define SOC_OCV_POINTS          11
+
+//----------------------------------------------------------------------------------------------------
+// Constants
+// Rested cell voltage in mV at 0%, 10% ... 100% SOC (typical NMC)
+static const unsigned int OCVTable[SOC_OCV_POINTS] =
+    {3000, 3450, 3550, 3610, 3660, 3710, 3780, 3860, 3950, 4050, 4180};
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+#pragma PERSISTENT(SOC_Store);
+SOCStore_t SOC_Store = {0, 0};
+
+static int32_t Charge_CC = 0;
+static bool Seeded = false;
+static bool RestCorrected = false;
+static unsigned int Rest_CT = 0;
+static uint8_t Save_CT = 0;
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static void SOC_Correct_OCV(void);
+static void SOC_Save(void);
+
+//------------------------------------------------------//--------------------------------------------
+void Init_SOC(void)
+{
+    Seeded = (SOC_Store.Valid==SOC_VALID_KEY);
+    if(Seeded)
+    {   Charge_CC = SOC_Store.Charge_CC;    }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Add one CC sample (offset already removed), called once per alert cycle with CC_READY set
+void SOC_Update(signed int cc)
+{
+    if(!Seeded)
+    {   SOC_Correct_OCV();
+        Seeded = true;      }
+
+    Charge_CC += cc;
+    if(Charge_CC<0)
+    {   Charge_CC = 0;  }
+    if(Charge_CC>SOC_FULL_CC)
+    {   Charge_CC = SOC_FULL_CC;    }
+
+    if(cc<SOC_REST_COUNTS && cc>-SOC_REST_COUNTS)
+    {
+        if(Rest_CT<SOC_REST_CYCLES)
+        {   Rest_CT++;  }
+        else if(!RestCorrected && !Balance_Bleeding())
+        {   SOC_Correct_OCV();
+            RestCorrected = true;   }
+    }
+    else
+    {   Rest_CT = 0;
+        RestCorrected = false;  }
+
+    Save_CT++;
+    if(Save_CT>=SOC_SAVE_CYCLES)
+    {   Save_CT = 0;
+        SOC_Save();     }
+}
+
+//----------------------------------------------------------------------------------------------------
+unsigned int SOC_Get_mAh(void)
+{   return Charge_CC/CC_COUNTS_PER_mAh;     }
+
+//----------------------------------------------------------------------------------------------------
+unsigned int SOC_Get_Permille(void)
+{   return Charge_CC/SOC_CC_PER_PERMILLE;   }
+
+//----------------------------------------------------------------------------------------------------
+// Reset the charge from the OCV of the lowest cell, the one that limits what the pack can deliver
+static void SOC_Correct_OCV(void)
+{
+    unsigned int mV = PackStats.Min_mV;
+    unsigned int Permille = 1000;
+    uint8_t CT;
+
+    if(mV<=OCVTable[0])
+    {   Permille = 0;   }
+    else
+    {
+        for(CT=1; CT<SOC_OCV_POINTS; CT++)
+        {
+            if(mV<OCVTable[CT])
+            {   Permille = (CT-1)*100 + ((unsigned long)(mV-OCVTable[CT-1])*100) /
+                                        (OCVTable[CT]-OCVTable[CT-1]);
+                break;                                                          }
+        }
+    }
+
+    Charge_CC = (int32_t)Permille*SOC_CC_PER_PERMILLE;
+}
+
+//----------------------------------------------------------------------------------------------------
+static void SOC_Save(void)
+{
+    uint8_t Prot = FRAM_Write_Enable();
+
+    SOC_Store.Valid = 0;
+    SOC_Store.Charge_CC = Charge_CC;
+    SOC_Store.Valid = SOC_VALID_KEY;
+
+    FRAM_Write_Restore(Prot);
+}
@@ -0,0 +1,45 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: SOC_Handler.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * State of charge from the coulomb counter, corrected from the cell OCV after a long rest and kept
+ * in FRAM across resets
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef SOC_HANDLER_H
+#define SOC_HANDLER_H
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//----------------------------------------------------------------------------------------------------
+// Structs
+
+//----------------------------------------------------------------------------------------------------
+// FRAM copy of the accumulated charge. Charge_CC is in raw CC samples so nothing is rounded away
+// however long the pack runs, 32 bits cover well over 100Ah at 10mOhm. Valid is cleared while
+// Charge_CC is being rewritten so a reset in the middle of a save is caught at startup.
+typedef struct
+{
+    int32_t Charge_CC;
+    uint16_t Valid;
+} SOCStore_t;
+
+#define SOC_VALID_KEY           0x50C5
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void Init_SOC(void);
+void SOC_Update(signed int cc);
+unsigned int SOC_Get_mAh(void);
+unsigned int SOC_Get_Permille(void);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern SOCStore_t SOC_Store;
+
+#endif
@@ -0,0 +1,169 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: SOH_Handler.c
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Per cell DC internal resistance estimated online from load steps, kept in FRAM, and the state of
+ * health that follows from it
+----------------------------------------------------------------------------------------------------*/
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "QmathLib.h"
+#include "Constants.h"
+#include "System.h"
+#include "BatteryData.h"
+#include "Balance_Handler.h"
+#include "SOH_Handler.h"
+
+//----------------------------------------------------------------------------------------------------
+// A snapshot is steady when its CC sample is within IR_STEADY_COUNTS of the one before, then the
+// current did not change while the CC was averaging and the cell voltages belong to that current.
+// Every steady snapshot becomes the reference. When a later steady snapshot, no more than
+// IR_MAX_GAP cycles on, finds the current moved by IR_MIN_STEP or more, each cell's dV/dI against
+// the reference is one resistance sample. The samples go through a first order filter in Q15. The
+// one division per step is done once, as a reciprocal of dI, so each cell costs a multiply. A
+// normal cycle only copies the cell voltages into the reference. Snapshots taken while cells are
+// bled are skipped, since the bleed current shifts the readings.
+
+//----------------------------------------------------------------------------------------------------
+// Defines
+#define IR_FILTER               _Q15(0.125)     //Each sample moves the estimate by 1/8
+// dV in mV times IR_SCALE over dI in CC counts is the resistance as a Q15 fraction of
+// IR_FULLSCALE_mOHM, one CC count is 8.44uV across RSENSE_uOHM
+#define IR_SCALE                ((RSENSE_uOHM*100UL*(32768/IR_FULLSCALE_mOHM) + 422)/844)
+#define IR_BOL_Q15              (IR_BOL_mOHM*(32768/IR_FULLSCALE_mOHM))
+#define IR_EOL_Q15              (IR_EOL_mOHM*(32768/IR_FULLSCALE_mOHM))
+
+//----------------------------------------------------------------------------------------------------
+// Variables
+#pragma PERSISTENT(SOH_Store);
+SOHStore_t SOH_Store = {{0}, 0};
+
+static unsigned int Ref_mV[PACK_NUM_CELLS];
+static signed int Ref_CC = 0;
+static signed int Prev_CC = 0;
+static uint8_t Ref_Age = IR_MAX_GAP+1;          //Past IR_MAX_GAP there is no reference
+
+//----------------------------------------------------------------------------------------------------
+// Local Function Prototypes
+static void SOH_Estimate(signed long step);
+
+//------------------------------------------------------//--------------------------------------------
+// Called once per alert cycle with CC_READY set, after the snapshot, cc with the offset removed
+void SOH_Update(signed int cc)
+{
+    signed long Step = (signed long)cc - Ref_CC;
+    bool Steady = (cc-Prev_CC < IR_STEADY_COUNTS) && (cc-Prev_CC > -IR_STEADY_COUNTS);
+    uint8_t CT;
+
+    Prev_CC = cc;
+
+    if(Balance_Bleeding())
+    {   Ref_Age = IR_MAX_GAP+1;
+        return;                 }
+
+    if(!Steady)
+    {
+        if(Ref_Age<=IR_MAX_GAP)
+        {   Ref_Age++;  }
+        return;
+    }
+
+    if(Ref_Age<=IR_MAX_GAP && (Step>=IR_MIN_STEP || Step<=-IR_MIN_STEP))
+    {   SOH_Estimate(Step);     }
+
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {   Ref_mV[CT] = Get_VCell_mV(CT);  }
+    Ref_CC = cc;
+    Ref_Age = 0;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Filtered resistance of a pack cell in uOhm, 0 until it has been measured
+uint32_t SOH_Get_IR_uOhm(uint8_t cell)
+{   return ((uint32_t)SOH_Store.IR_Q15[cell] * (IR_FULLSCALE_mOHM*1000UL)) >> 15;   }
+
+//----------------------------------------------------------------------------------------------------
+// 1000 at IR_BOL_mOHM or below (or not measured yet), 0 at IR_EOL_mOHM or above
+unsigned int SOH_Get_Permille(uint8_t cell)
+{
+    _q15 IR = SOH_Store.IR_Q15[cell];
+
+    if(IR<=IR_BOL_Q15)
+    {   return 1000;    }
+    if(IR>=IR_EOL_Q15)
+    {   return 0;       }
+    return ((uint32_t)(IR_EOL_Q15-IR) * 1000) / (IR_EOL_Q15-IR_BOL_Q15);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Pack cells (bit 0 is pack cell 0) above IR_WEAK_PERCENT of the average of the measured cells
+uint16_t SOH_Get_WeakCells(void)
+{
+    uint32_t Sum = 0;
+    uint16_t Weak = 0;
+    uint8_t Measured = 0;
+    uint8_t CT;
+
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {
+        if(SOH_Store.IR_Q15[CT]>0)
+        {   Sum += SOH_Store.IR_Q15[CT];
+            Measured++;                     }
+    }
+    if(Measured<2)
+    {   return 0;   }
+
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {
+        if((uint32_t)SOH_Store.IR_Q15[CT]*100*Measured > Sum*IR_WEAK_PERCENT)
+        {   Weak |= 1<<CT;  }
+    }
+    return Weak;
+}
+
+//----------------------------------------------------------------------------------------------------
+// One resistance sample per cell against the reference, filtered into FRAM. A cell whose voltage
+// moved the wrong way or out of range (noise, a relaxing cell) keeps its estimate.
+static void SOH_Estimate(signed long step)
+{
+    uint8_t Prot;
+    bool Neg = (step<0);
+    uint32_t Inv;
+    signed long dV;
+    signed long R;
+    uint8_t CT;
+
+    if(Neg)
+    {   step = -step;   }
+    Inv = (IR_SCALE*256UL + step/2) / step;
+
+    Prot = FRAM_Write_Enable();
+
+    for(CT=0; CT<PACK_NUM_CELLS; CT++)
+    {
+        dV = (signed long)Get_VCell_mV(CT) - Ref_mV[CT];
+        if(Neg)
+        {   dV = -dV;   }
+        if(dV<=0)
+        {   continue;   }
+
+        R = (dV*Inv) >> 8;
+        if(R>32767)
+        {   continue;   }
+
+        if(SOH_Store.IR_Q15[CT]==0)
+        {   SOH_Store.IR_Q15[CT] = R;   }
+        else
+        {   SOH_Store.IR_Q15[CT] += _Q15mpy(IR_FILTER, (_q15)R - SOH_Store.IR_Q15[CT]);    }
+    }
+
+    if(SOH_Store.Steps<0xFFFF)
+    {   SOH_Store.Steps++;  }
+
+    FRAM_Write_Restore(Prot);
+}
@@ -0,0 +1,44 @@
+/*----------------------------------------------------------------------------------------------------
+ * Title: SOH_Handler.h
+ * Authors: Nathaniel VerLee, 2020-2022
+ * Contributors: Ryan Heacock, Kurt Snieckus, Matthew Pennock, 2020-2022
+ *
+ * Per cell DC internal resistance estimated online from load steps, kept in FRAM, and the state of
+ * health that follows from it
+----------------------------------------------------------------------------------------------------*/
+
+#ifndef SOH_HANDLER_H
+#define SOH_HANDLER_H
+
+//----------------------------------------------------------------------------------------------------
+// This file includes:
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "QmathLib.h"
+#include "Constants.h"
+
+//----------------------------------------------------------------------------------------------------
+// Structs
+
+//----------------------------------------------------------------------------------------------------
+// FRAM copy of the filtered resistances, a Q15 fraction of IR_FULLSCALE_mOHM per pack cell. Steps
+// counts the load steps seen (saturating), 0 means nothing has been measured yet.
+typedef struct
+{
+    _q15 IR_Q15[PACK_NUM_CELLS];
+    uint16_t Steps;
+} SOHStore_t;
+
+//----------------------------------------------------------------------------------------------------
+// Function Prototypes
+void SOH_Update(signed int cc);
+uint32_t SOH_Get_IR_uOhm(uint8_t cell);
+unsigned int SOH_Get_Permille(uint8_t cell);
+uint16_t SOH_Get_WeakCells(void);
+
+//----------------------------------------------------------------------------------------------------
+// Global Variables
+extern SOHStore_t SOH_Store;
+
+#endif
@@ -33,6 +33,23 @@ static const ColorState_t ColorMap[4] =
     {0, 1}, // Green
 };
 
+//----------------------------------------------------------------------------------------------------
+// Raise MCLK/SMCLK from the 1MHz default to 8MHz (see MCLK_FREQ_HZ), DCO is FLL locked to REFO
+void Init_Clock(void)
+{
+    __bis_SR_register(SCG0);                    // Disable FLL
+    CSCTL3 |= SELREF__REFOCLK;                  // Set REFO as FLL reference source
+    CSCTL0 = 0;                                 // Clear DCO and MOD registers
+    CSCTL1 &= ~(DCORSEL_7);                     // Clear DCO frequency select bits first
+    CSCTL1 |= DCORSEL_3;                        // Set DCO = 8MHz
+    CSCTL2 = FLLD_0 + 243;                      // DCODIV = (243+1) * 32768Hz = 8MHz
+    __delay_cycles(3);
+    __bic_SR_register(SCG0);                    // Enable FLL
+    while(CSCTL7 & (FLLUNLOCK0 | FLLUNLOCK1));  // Poll until FLL is locked
+
+    CSCTL4 = SELMS__DCOCLKDIV | SELA__REFOCLK;  // MCLK = SMCLK = DCOCLKDIV, ACLK = REFO
+}
+
 //----------------------------------------------------------------------------------------------------
 // Configure GPIO
 void Init_GPIO()
@@ -114,6 +131,32 @@ void Init_Sys()
     PM5CTL0 &= ~LOCKLPM5;
 }
 
+//----------------------------------------------------------------------------------------------------
+// Start the free running timebase, see TIMEBASE_TICKS_PER_MS
+void Init_Timebase(void)
+{
+    TB1CTL = TBSSEL_2 | ID_3 | TBCLR | MC_2;    // SMCLK/8, clear TBR, continuous mode
+}
+
+//----------------------------------------------------------------------------------------------------
+unsigned int Timebase_Now(void)
+{   return TB1R;    }
+
+//----------------------------------------------------------------------------------------------------
+// #pragma PERSISTENT variables live in program FRAM, which comes out of reset write protected
+// (PFWP). Open it for a runtime update, then put back whatever protection was there before.
+uint8_t FRAM_Write_Enable(void)
+{
+    uint8_t Prev = SYSCFG0 & (PFWP|DFWP);
+
+    SYSCFG0 = FRWPPW | (Prev & ~PFWP);
+    return Prev;
+}
+
+//----------------------------------------------------------------------------------------------------
+void FRAM_Write_Restore(uint8_t prev)
+{   SYSCFG0 = FRWPPW | prev;    }
+
 //----------------------------------------------------------------------------------------------------
 void Setup_GateDriver(void)
 {
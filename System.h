@@ -28,6 +28,9 @@
 
 // Port Mapping for I2C_AFE
 #define I2C_AFE_PSEL0 P1SEL0
+#define I2C_AFE_POUT P1OUT
+#define I2C_AFE_PIN  P1IN
+#define I2C_AFE_PDIR P1DIR
 #define I2C_AFE_SDA BIT2
 #define I2C_AFE_SCL BIT3
 
@@ -86,6 +89,19 @@
 #define GTDRV_CPEN BIT1
 #define GTDRV_PCHG BIT2
 
+//--------------------------------------------------
+// Clocks, set up by Init_Clock(). DCO locked to REFO by the FLL, MCLK = SMCLK = 8MHz which is
+// the fastest the FR2155 runs without FRAM wait states. ACLK = REFO = 32768Hz.
+#define MCLK_FREQ_HZ            8000000UL
+#define SMCLK_FREQ_HZ           8000000UL
+#define DELAY_100MS             (MCLK_FREQ_HZ/10)   //For __delay_cycles()
+
+//--------------------------------------------------
+// Timebase, Timer1_B3 free running in continuous mode from SMCLK/8. CCR1/CCR2 are used by
+// I2C_Handler for transfer timeouts and retry backoff, TB1R can be read as a timestamp anywhere.
+#define TIMEBASE_TICKS_PER_MS   1000        //SMCLK/8 = 1MHz, 1 tick = 1uS
+#define TIMEBASE_CYCLES_PER_TICK (MCLK_FREQ_HZ/(TIMEBASE_TICKS_PER_MS*1000UL))
+
 // GPIO Mappings for Debug Pins:
 #define DBUGOUT_POUT P4OUT
 #define DBUGOUT_PDIR P4DIR
@@ -162,8 +178,13 @@ typedef struct
 //----------------------------------------------------------------------------------------------------
 // FUNCTION PROTOTYPES
 
+void Init_Clock(void);
 void Init_GPIO(void);
 void Init_Sys(void);
+void Init_Timebase(void);
+unsigned int Timebase_Now(void);
+uint8_t FRAM_Write_Enable(void);
+void FRAM_Write_Restore(uint8_t prev);
 
 void Setup_Buttons(void);
 void Setup_LEDs(void);